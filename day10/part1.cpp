@@ -3,6 +3,10 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
 #include "string_utils.h"
 
 using namespace std;
@@ -10,15 +14,36 @@ using namespace std;
 struct parse_line_result {
     enum {ok, incomplete, corrupted} status;
     char error_char;
-    const char *pc_next;
 };
 
+// Every byte is classified as a chunk open char, a chunk close char or neither; for open and close
+// chars the low bits hold the bracket kind.
+const uint8_t bracket_open = 0x10;
+const uint8_t bracket_close = 0x20;
+const uint8_t bracket_kind_mask = 0x03;
+
+constexpr array<uint8_t, 256> build_bracket_classes() {
+    array<uint8_t, 256> classes = {};
+
+    const char open_chars[] = "([{<";
+    const char close_chars[] = ")]}>";
+    for (uint8_t kind = 0; kind < 4; ++kind) {
+        classes[static_cast<uint8_t>(open_chars[kind])] = bracket_open | kind;
+        classes[static_cast<uint8_t>(close_chars[kind])] = bracket_close | kind;
+    }
+
+    return classes;
+}
+
+constexpr array<uint8_t, 256> g_bracket_classes = build_bracket_classes();
+
+// lines are classified in blocks of this many bytes, one bit per byte
+const size_t classify_block_size = 32;
+
 vector<string> parse_input(const string &filename);
-int calculate_syntax_error_score(const vector<string> &lines);
-parse_line_result parse_line(const string &line);
-void consume_chunk(const char *pc_chunk_start, parse_line_result &result);
-bool chunk_open_char(char c);
-bool chunk_open_close_chars_match(char open, char close);
+int64_t calculate_syntax_error_score(const vector<string> &lines);
+parse_line_result parse_line(const string &line, vector<uint8_t> &open_chars_stack);
+uint32_t open_chars_mask(const uint8_t *block, size_t block_size);
 
 
 int main(int argc, char *argv[]) {
@@ -45,80 +70,71 @@ vector<string> parse_input(const string &filename) {
     return lines;
 }
 
-int calculate_syntax_error_score(const vector<string> &lines) {
-    int error_score = 0;
-
-    auto score_for = [] (char error_char) {
-        switch (error_char) {
-            case ')': return 3;
-            case ']': return 57;
-            case '}': return 1197;
-            case '>': return 25137;
-            default: throw runtime_error("Invalid error char");
-        }
-    };
+int64_t calculate_syntax_error_score(const vector<string> &lines) {
+    const int64_t syntax_error_points[] = {3, 57, 1197, 25137};  // indexed by bracket kind
+    vector<uint8_t> open_chars_stack;
 
+    int64_t error_score = 0;
     for (const string &line : lines) {
-        parse_line_result result = parse_line(line);
+        parse_line_result result = parse_line(line, open_chars_stack);
         if (result.status == parse_line_result::corrupted) {
-            error_score += score_for(result.error_char);
+            uint8_t error_class = g_bracket_classes[static_cast<uint8_t>(result.error_char)];
+            if (!(error_class & bracket_close)) throw runtime_error("Invalid error char");
+
+            error_score += syntax_error_points[error_class & bracket_kind_mask];
         }
     }
 
     return error_score;
 }
 
-parse_line_result parse_line(const string &line) {
-    parse_line_result result = {.status = parse_line_result::ok};
-
-    for (const char *pc_next_chunk_start = line.data();
-         result.status == parse_line_result::ok && *pc_next_chunk_start != '\0';
-         pc_next_chunk_start = result.pc_next) {
-
-        consume_chunk(pc_next_chunk_start, result);
-    }
-
-    return result;
-}
-
-void consume_chunk(const char *pc_chunk_start, parse_line_result &result) {
-    if (!chunk_open_char(*pc_chunk_start)) {
-        result.status = parse_line_result::corrupted;
-        result.error_char = *pc_chunk_start;
-        return;
-    }
-
-    const char *pc_next = pc_chunk_start + 1;
-    while (chunk_open_char(*pc_next)) {
-        consume_chunk(pc_next, result);
-        if (result.status != parse_line_result::ok) return;
-
-        pc_next = result.pc_next;
-    }
-    const char *pc_chunk_end = pc_next;
-
-    if (!chunk_open_close_chars_match(*pc_chunk_start, *pc_chunk_end)) {
-        result.status = *pc_chunk_end == '\0' ? parse_line_result::incomplete : parse_line_result::corrupted;
-        result.error_char = *pc_chunk_end;
-        return;
+parse_line_result parse_line(const string &line, vector<uint8_t> &open_chars_stack) {
+    // the chunks still open are kept on an explicit stack, so the nesting depth is only limited by
+    // the line's length; the stack is only ever grown and stops allocating once it fits the longest line
+    if (open_chars_stack.size() < line.size()) open_chars_stack.resize(line.size());
+
+    uint8_t *stack = open_chars_stack.data();
+    size_t depth = 0;
+
+    const uint8_t *line_data = reinterpret_cast<const uint8_t *>(line.data());
+    for (size_t block_start = 0; block_start < line.size(); block_start += classify_block_size) {
+        const uint8_t *block = line_data + block_start;
+        size_t block_size = min(classify_block_size, line.size() - block_start);
+        uint32_t open_mask = open_chars_mask(block, block_size);
+
+        for (size_t i = 0; i < block_size;) {
+            // runs of open chars are pushed in bulk
+            size_t n_open = static_cast<size_t>(countr_one(open_mask >> i));
+            if (n_open > 0) {
+                memcpy(stack + depth, block + i, n_open);
+                depth += n_open;
+                i += n_open;
+                continue;
+            }
+
+            uint8_t close_class = g_bracket_classes[block[i]];
+            if (!(close_class & bracket_close) || depth == 0 ||
+                (g_bracket_classes[stack[depth - 1]] & bracket_kind_mask) != (close_class & bracket_kind_mask)) {
+
+                return {parse_line_result::corrupted, static_cast<char>(block[i])};
+            }
+
+            --depth;
+            ++i;
+        }
     }
 
-    result.pc_next = pc_chunk_end + 1;
+    return {depth == 0 ? parse_line_result::ok : parse_line_result::incomplete, '\0'};
 }
 
-bool chunk_open_char(char c) {
-    switch (c) {
-        case '(':
-        case '[':
-        case '{':
-        case '<':
-            return true;
+uint32_t open_chars_mask(const uint8_t *block, size_t block_size) {
+    // plain compares rather than table lookups, so that the loop vectorises
+    uint32_t mask = 0;
+    for (size_t i = 0; i < block_size; ++i) {
+        uint8_t c = block[i];
+        uint32_t is_open = (c == '(') | (c == '[') | (c == '{') | (c == '<');
+        mask |= is_open << i;
     }
 
-    return false;
-}
-
-bool chunk_open_close_chars_match(char open, char close) {
-    return (open == '(' && close == ')') || (open == '[' && close == ']') ||
-           (open == '{' && close == '}') || (open == '<' && close == '>');
+    return mask;
 }
@@ -3,24 +3,61 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <thread>
+#include <limits>
 #include "string_utils.h"
+#include "parallel_utils.h"
 
 using namespace std;
 
 struct parse_line_result {
     enum {ok, incomplete, corrupted} status;
-    string completion_string;
     char error_char;
-    const char *pc_next;
+    uint64_t completion_score;
 };
 
-vector<string> parse_input(const string &filename);
-uint64_t calculate_autocomplete_score(const vector<string> &lines);
-parse_line_result parse_line(const string &line);
-void consume_chunk(const char *pc_chunk_start, parse_line_result &result);
-bool chunk_open_char(char c);
-char close_char_for(char c);
-bool chunk_open_close_chars_match(char open, char close);
+// Completion scores above 64 bits saturate to this value, which is no valid score itself (its base 5
+// digits include a 0), and still sorts above every score that fits.
+const uint64_t completion_score_overflow = numeric_limits<uint64_t>::max();
+
+struct line_scores {
+    uint64_t syntax_error_score;
+    vector<uint64_t> completion_scores;
+};
+
+// Every byte is classified as a chunk open char, a chunk close char or neither; for open and close
+// chars the low bits hold the bracket kind, which is also the kind's completion points minus one.
+const uint8_t bracket_open = 0x10;
+const uint8_t bracket_close = 0x20;
+const uint8_t bracket_kind_mask = 0x03;
+
+constexpr array<uint8_t, 256> build_bracket_classes() {
+    array<uint8_t, 256> classes = {};
+
+    const char open_chars[] = "([{<";
+    const char close_chars[] = ")]}>";
+    for (uint8_t kind = 0; kind < 4; ++kind) {
+        classes[static_cast<uint8_t>(open_chars[kind])] = bracket_open | kind;
+        classes[static_cast<uint8_t>(close_chars[kind])] = bracket_close | kind;
+    }
+
+    return classes;
+}
+
+constexpr array<uint8_t, 256> g_bracket_classes = build_bracket_classes();
+
+// lines are classified in blocks of this many bytes, one bit per byte
+const size_t classify_block_size = 32;
+
+line_scores score_lines(istream &input, unsigned n_threads);
+void score_line_range(const vector<string> &lines, size_t i_begin, size_t i_end, line_scores &scores);
+uint64_t calculate_autocomplete_score(vector<uint64_t> &completion_scores);
+parse_line_result parse_line(const string &line, vector<uint8_t> &open_chars_stack);
+uint32_t open_chars_mask(const uint8_t *block, size_t block_size);
 
 
 int main(int argc, char *argv[]) {
@@ -30,119 +67,128 @@ int main(int argc, char *argv[]) {
     }
     const string filename = argv[1];
 
-    vector<string> lines = parse_input(filename);
-
-    cout << "Syntax error score: " << calculate_autocomplete_score(lines) << endl;
-}
-
-vector<string> parse_input(const string &filename) {
     ifstream input_file(filename);
-    vector<string> lines;
+    line_scores scores = score_lines(input_file, max(1u, thread::hardware_concurrency()));
 
-    string line;
-    while (getline(input_file, line)) {
-        lines.push_back(line);
+    cout << "Syntax error score: " << scores.syntax_error_score << endl;
+    uint64_t autocomplete_score = calculate_autocomplete_score(scores.completion_scores);
+    if (autocomplete_score == completion_score_overflow) {
+        cout << "Autocomplete score: does not fit into 64 bits" << endl;
     }
+    else {
+        cout << "Autocomplete score: " << autocomplete_score << endl;
+    }
+}
 
-    return lines;
+line_scores score_lines(istream &input, unsigned n_threads) {
+    // every thread scores its slice of lines on its own; the syntax error scores are summed and the
+    // completion scores concatenated, since only their median is needed in the end
+    vector<line_scores> thread_scores(n_threads);
+
+    line_scores scores = {0, {}};
+    process_lines_in_parallel(input, n_threads,
+        [&] (const vector<string> &lines, size_t i_begin, size_t i_end, unsigned i_thread) {
+            score_line_range(lines, i_begin, i_end, thread_scores[i_thread]);
+        },
+        [&] (unsigned i_thread) {
+            line_scores &chunk_scores = thread_scores[i_thread];
+            scores.syntax_error_score += chunk_scores.syntax_error_score;
+            scores.completion_scores.insert(scores.completion_scores.end(),
+                                            chunk_scores.completion_scores.begin(), chunk_scores.completion_scores.end());
+        });
+
+    return scores;
 }
 
-uint64_t calculate_autocomplete_score(const vector<string> &lines) {
-    vector<uint64_t> scores;
-
-    auto score_for = [] (const string &completion_string) {
-        uint64_t score = 0;
-        for (char c : completion_string) {
-            score *= 5;
-            switch (c) {
-                case ')': score += 1; break;
-                case ']': score += 2; break;
-                case '}': score += 3; break;
-                case '>': score += 4; break;
-                default: throw runtime_error("Invalid completion char");
-            }
-        }
+void score_line_range(const vector<string> &lines, size_t i_begin, size_t i_end, line_scores &scores) {
+    const uint64_t syntax_error_points[] = {3, 57, 1197, 25137};  // indexed by bracket kind
+    vector<uint8_t> open_chars_stack;
 
-        return score;
-    };
+    scores.syntax_error_score = 0;
+    scores.completion_scores.clear();
 
-    for (const string &line : lines) {
-        parse_line_result result = parse_line(line);
-        if (result.status == parse_line_result::incomplete) {
-            scores.push_back(score_for(result.completion_string));
+    for (size_t i = i_begin; i < i_end; ++i) {
+        parse_line_result result = parse_line(lines[i], open_chars_stack);
+        if (result.status == parse_line_result::corrupted) {
+            uint8_t error_class = g_bracket_classes[static_cast<uint8_t>(result.error_char)];
+            if (!(error_class & bracket_close)) throw runtime_error("Invalid char in line");
+
+            scores.syntax_error_score += syntax_error_points[error_class & bracket_kind_mask];
+        }
+        else if (result.status == parse_line_result::incomplete) {
+            scores.completion_scores.push_back(result.completion_score);
         }
     }
-
-    sort(scores.begin(), scores.end());
-    return scores[scores.size() / 2];
 }
 
-parse_line_result parse_line(const string &line) {
-    parse_line_result result = {.status = parse_line_result::ok};
+uint64_t calculate_autocomplete_score(vector<uint64_t> &completion_scores) {
+    if (completion_scores.empty()) throw runtime_error("No incomplete lines");
 
-    for (const char *pc_next_chunk_start = line.data();
-         result.status == parse_line_result::ok && *pc_next_chunk_start != '\0';
-         pc_next_chunk_start = result.pc_next) {
-
-        consume_chunk(pc_next_chunk_start, result);
-    }
+    auto middle_it = completion_scores.begin() + static_cast<ptrdiff_t>(completion_scores.size() / 2);
+    nth_element(completion_scores.begin(), middle_it, completion_scores.end());
 
-    return result;
+    return *middle_it;
 }
 
-void consume_chunk(const char *pc_chunk_start, parse_line_result &result) {
-    if (!chunk_open_char(*pc_chunk_start)) {
-        result.status = parse_line_result::corrupted;
-        result.error_char = *pc_chunk_start;
-        return;
-    }
+parse_line_result parse_line(const string &line, vector<uint8_t> &open_chars_stack) {
+    // the stack is only ever grown, so it stops allocating once it fits the longest line
+    if (open_chars_stack.size() < line.size()) open_chars_stack.resize(line.size());
+
+    uint8_t *stack = open_chars_stack.data();
+    size_t depth = 0;
+
+    const uint8_t *line_data = reinterpret_cast<const uint8_t *>(line.data());
+    for (size_t block_start = 0; block_start < line.size(); block_start += classify_block_size) {
+        const uint8_t *block = line_data + block_start;
+        size_t block_size = min(classify_block_size, line.size() - block_start);
+        uint32_t open_mask = open_chars_mask(block, block_size);
+
+        for (size_t i = 0; i < block_size;) {
+            // runs of open chars are pushed in bulk
+            size_t n_open = static_cast<size_t>(countr_one(open_mask >> i));
+            if (n_open > 0) {
+                memcpy(stack + depth, block + i, n_open);
+                depth += n_open;
+                i += n_open;
+                continue;
+            }
 
-    const char *pc_next = pc_chunk_start + 1;
-    while (chunk_open_char(*pc_next)) {
-        consume_chunk(pc_next, result);
-        if (result.status == parse_line_result::corrupted) return;
+            uint8_t close_class = g_bracket_classes[block[i]];
+            if (!(close_class & bracket_close) || depth == 0 ||
+                (g_bracket_classes[stack[depth - 1]] & bracket_kind_mask) != (close_class & bracket_kind_mask)) {
 
-        pc_next = result.pc_next;
-    }
-    const char *pc_chunk_end = pc_next;
+                return {parse_line_result::corrupted, static_cast<char>(block[i]), 0};
+            }
 
-    if (chunk_open_close_chars_match(*pc_chunk_start, *pc_chunk_end)) {
-        result.pc_next = pc_chunk_end + 1;
-    }
-    else if (*pc_chunk_end == '\0') {
-        result.status = parse_line_result::incomplete;
-        result.completion_string += close_char_for(*pc_chunk_start);
-        result.pc_next = pc_chunk_end;
-    }
-    else {
-        result.status = parse_line_result::corrupted;
-        result.error_char = *pc_chunk_end;
+            --depth;
+            ++i;
+        }
     }
-}
 
-bool chunk_open_char(char c) {
-    switch (c) {
-        case '(':
-        case '[':
-        case '{':
-        case '<':
-            return true;
+    if (depth == 0) return {parse_line_result::ok, '\0', 0};
+
+    // the chunks still open on the stack are closed innermost first
+    uint64_t completion_score = 0;
+    while (depth > 0) {
+        uint64_t points = (g_bracket_classes[stack[--depth]] & bracket_kind_mask) + 1u;
+        if (__builtin_mul_overflow(completion_score, 5, &completion_score) ||
+            __builtin_add_overflow(completion_score, points, &completion_score)) {
+
+            return {parse_line_result::incomplete, '\0', completion_score_overflow};
+        }
     }
 
-    return false;
+    return {parse_line_result::incomplete, '\0', completion_score};
 }
 
-char close_char_for(char c) {
-    switch (c) {
-        case '(': return ')';
-        case '[': return ']';
-        case '{': return '}';
-        case '<': return '>';
-        default: throw runtime_error("Invalid open char");
+uint32_t open_chars_mask(const uint8_t *block, size_t block_size) {
+    // plain compares rather than table lookups, so that the loop vectorises
+    uint32_t mask = 0;
+    for (size_t i = 0; i < block_size; ++i) {
+        uint8_t c = block[i];
+        uint32_t is_open = (c == '(') | (c == '[') | (c == '{') | (c == '<');
+        mask |= is_open << i;
     }
-}
 
-bool chunk_open_close_chars_match(char open, char close) {
-    return (open == '(' && close == ')') || (open == '[' && close == ']') ||
-           (open == '{' && close == '}') || (open == '<' && close == '>');
+    return mask;
 }
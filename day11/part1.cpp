@@ -2,20 +2,34 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <bit>
+#include <algorithm>
 
 using namespace std;
 
-struct coord {
-    int i;
-    int j;
-};
+class octopus_grid {
+public:
+    octopus_grid(istream &input);
+
+    int rows() const;
+    int cols() const;
+
+    int64_t simulate_step();
 
-const int grid_size = 10;
-int g_grid[grid_size][grid_size];
+private:
+    // Energy levels are kept as 4 bit-planes: bit j of word w of a row in planes[k] is bit k of the
+    // energy level of the octopus in column 64 * w + j, so a whole row is updated 64 columns at a time.
+    vector<uint64_t> planes[4];
+    int _rows;
+    int _cols;
+    int row_words;
+    uint64_t last_word_mask;
+
+    void add_to_word(size_t i_word, uint64_t increments);
+    uint64_t take_flashing(size_t i_word);
+};
 
-void parse_input(const string &filename);
-int simulate_steps();
-int simulate_step();
+int64_t simulate_steps(octopus_grid &grid, int n_steps);
 
 
 int main(int argc, char *argv[]) {
@@ -25,70 +39,138 @@ int main(int argc, char *argv[]) {
     }
     const string filename = argv[1];
 
-    parse_input(filename);
+    ifstream input_file(filename);
+    octopus_grid grid(input_file);
 
-    cout << "Flashes after 100 steps: " << simulate_steps() << endl;
+    cout << "Flashes after 100 steps: " << simulate_steps(grid, 100) << endl;
 }
 
-void parse_input(const string &filename) {
-    ifstream input_file(filename);
-
+octopus_grid::octopus_grid(istream &input) {
+    vector<string> lines;
     string line;
-    for (size_t i_row = 0; i_row < grid_size; ++i_row) {
-        getline(input_file, line);
-        for (size_t i_col = 0; i_col < grid_size; ++i_col) {
-            g_grid[i_row][i_col] = line[i_col] - '0';
+    while (getline(input, line)) {
+        if (line.empty()) continue;
+        if (!lines.empty() && line.size() != lines[0].size()) throw runtime_error("Grid rows differ in length");
+
+        lines.push_back(line);
+    }
+    if (lines.empty()) throw runtime_error("Empty grid");
+
+    this->_rows = static_cast<int>(lines.size());
+    this->_cols = static_cast<int>(lines[0].size());
+    this->row_words = (this->_cols + 63) / 64;
+    this->last_word_mask = this->_cols % 64 == 0 ? ~uint64_t(0) : (uint64_t(1) << (this->_cols % 64)) - 1;
+
+    for (vector<uint64_t> &plane : this->planes) {
+        plane.assign(static_cast<size_t>(this->_rows * this->row_words), 0);
+    }
+
+    for (size_t i_row = 0; i_row < lines.size(); ++i_row) {
+        for (size_t i_col = 0; i_col < lines[i_row].size(); ++i_col) {
+            int energy = lines[i_row][i_col] - '0';
+            if (energy < 0 || energy > 9) throw runtime_error("Invalid energy level");
+
+            size_t i_word = i_row * static_cast<size_t>(this->row_words) + i_col / 64;
+            for (int k = 0; k < 4; ++k) {
+                this->planes[k][i_word] |= static_cast<uint64_t>((energy >> k) & 1) << (i_col % 64);
+            }
         }
     }
 }
 
-int simulate_steps() {
-    int flashes = 0;
+int octopus_grid::rows() const {
+    return this->_rows;
+}
 
-    for (int i = 0; i < 100; ++i) {
-        flashes += simulate_step();
+int octopus_grid::cols() const {
+    return this->_cols;
+}
+
+int64_t octopus_grid::simulate_step() {
+    const size_t n_words = this->planes[0].size();
+    const size_t row_words = static_cast<size_t>(this->row_words);
+    auto word_mask = [&] (size_t i_word) { return i_word % row_words == row_words - 1 ? this->last_word_mask : ~uint64_t(0); };
+
+    vector<uint64_t> flashed(n_words);
+    vector<uint64_t> flashing(n_words);
+    vector<uint64_t> next_flashing(n_words);
+
+    bool any_flashing = false;
+    for (size_t i_word = 0; i_word < n_words; ++i_word) {
+        this->add_to_word(i_word, word_mask(i_word));
+        flashing[i_word] = flashed[i_word] = this->take_flashing(i_word);
+        any_flashing |= flashing[i_word] != 0;
+    }
+
+    // Every round adds the masks of the octopuses which flashed in the previous round, shifted onto
+    // their neighbours, until no new octopus flashes. The masks are added one at a time, so the
+    // energy levels never exceed 10 and fit into the 4 planes.
+    while (any_flashing) {
+        fill(next_flashing.begin(), next_flashing.end(), 0);
+        any_flashing = false;
+
+        for (int i = 0; i < this->_rows; ++i) {
+            for (int i_source = max(0, i - 1); i_source <= min(this->_rows - 1, i + 1); ++i_source) {
+                const uint64_t *source = flashing.data() + static_cast<size_t>(i_source) * row_words;
+
+                for (size_t w = 0; w < row_words; ++w) {
+                    uint64_t carried_left = w > 0 ? source[w - 1] >> 63 : 0;
+                    uint64_t carried_right = w + 1 < row_words ? source[w + 1] << 63 : 0;
+                    uint64_t neighbour_masks[] = {
+                        (source[w] << 1) | carried_left,
+                        (source[w] >> 1) | carried_right,
+                        i_source != i ? source[w] : 0,
+                    };
+
+                    size_t i_word = static_cast<size_t>(i) * row_words + w;
+                    for (uint64_t neighbours : neighbour_masks) {
+                        this->add_to_word(i_word, neighbours & word_mask(i_word) & ~flashed[i_word]);
+
+                        uint64_t new_flashing = this->take_flashing(i_word);
+                        flashed[i_word] |= new_flashing;
+                        next_flashing[i_word] |= new_flashing;
+                    }
+                    any_flashing |= next_flashing[i_word] != 0;
+                }
+            }
+        }
+
+        swap(flashing, next_flashing);
+    }
+
+    int64_t flashes = 0;
+    for (uint64_t flashed_word : flashed) {
+        flashes += popcount(flashed_word);
     }
 
     return flashes;
 }
 
-int simulate_step() {
-    int flashes = 0;
+void octopus_grid::add_to_word(size_t i_word, uint64_t increments) {
+    // ripple-carry adder adding 1 to every column set in increments
+    uint64_t carry = increments;
+    for (vector<uint64_t> &plane : this->planes) {
+        uint64_t next_carry = plane[i_word] & carry;
+        plane[i_word] ^= carry;
+        carry = next_carry;
+    }
+}
 
-    vector<coord> flashing;
-    for (int i = 0; i < grid_size; ++i) {
-        for (int j = 0; j < grid_size; ++j) {
-            if (++g_grid[i][j] > 9) {
-                g_grid[i][j] = 0;
-                flashing.push_back({i, j});
-            }
-        }
+uint64_t octopus_grid::take_flashing(size_t i_word) {
+    // energy levels above 9 have the 8 bit and either the 4 or the 2 bit set
+    uint64_t flashing = this->planes[3][i_word] & (this->planes[2][i_word] | this->planes[1][i_word]);
+    for (vector<uint64_t> &plane : this->planes) {
+        plane[i_word] &= ~flashing;
     }
 
-    auto stimulate = [&flashing] (int i, int j) {
-        if (i < 0 || j < 0 || i >= grid_size || j >= grid_size) return;
-        if (g_grid[i][j] == 0) return;
+    return flashing;
+}
+
+int64_t simulate_steps(octopus_grid &grid, int n_steps) {
+    int64_t flashes = 0;
 
-        if (++g_grid[i][j] > 9) {
-            g_grid[i][j] = 0;
-            flashing.push_back({i, j});
-        }
-    };
-
-    while (!flashing.empty()) {
-        int i = flashing.back().i;
-        int j = flashing.back().j;
-        flashing.pop_back();
-        ++flashes;
-
-        stimulate(i - 1, j - 1);
-        stimulate(i - 1, j);
-        stimulate(i - 1, j + 1);
-        stimulate(i, j - 1);
-        stimulate(i, j + 1);
-        stimulate(i + 1, j - 1);
-        stimulate(i + 1, j);
-        stimulate(i + 1, j + 1);
+    for (int i = 0; i < n_steps; ++i) {
+        flashes += grid.simulate_step();
     }
 
     return flashes;
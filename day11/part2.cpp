@@ -2,92 +2,311 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <bit>
+#include <optional>
+#include <unordered_map>
+#include <charconv>
+#include <limits>
+#include <algorithm>
 
 using namespace std;
 
-struct coord {
-    int i;
-    int j;
+class octopus_grid {
+public:
+    octopus_grid(istream &input);
+
+    int rows() const;
+    int cols() const;
+
+    int64_t simulate_step();
+    uint64_t state_hash() const;
+
+    bool operator == (const octopus_grid &rhs) const;
+
+private:
+    // Energy levels are kept as 4 bit-planes: bit j of word w of a row in planes[k] is bit k of the
+    // energy level of the octopus in column 64 * w + j, so a whole row is updated 64 columns at a time.
+    vector<uint64_t> planes[4];
+    int _rows;
+    int _cols;
+    int row_words;
+    uint64_t last_word_mask;
+
+    void add_to_word(size_t i_word, uint64_t increments);
+    uint64_t take_flashing(size_t i_word);
 };
 
-const int grid_size = 10;
-int g_grid[grid_size][grid_size];
+// The grid state after step `start + length` equals the state after step `start`, so from then on
+// the flashes repeat every `length` steps.
+struct cycle_info {
+    int64_t start;
+    int64_t length;
+};
+
+// Total flashes over up to 2^63 steps, which need more than 64 bits.
+typedef unsigned __int128 flash_count;
 
-void parse_input(const string &filename);
-int calculate_sync_flash_step();
-int simulate_step();
+optional<cycle_info> simulate(octopus_grid &grid, int64_t max_steps, bool stop_at_sync, vector<int64_t> &step_flashes);
+optional<int64_t> calculate_sync_flash_step(octopus_grid grid);
+flash_count calculate_flashes(octopus_grid grid, int64_t n_steps);
+string flash_count_to_string(flash_count flashes);
 
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        cout << "Usage: <exe> <filename>\n";
+        cout << "Usage: <exe> <filename> [<simulated steps>]\n";
         return 1;
     }
     const string filename = argv[1];
 
-    parse_input(filename);
+    ifstream input_file(filename);
+    octopus_grid grid(input_file);
 
-    cout << "Synchronized flash after step: " << calculate_sync_flash_step() << endl;
-}
+    if (argc >= 3) {
+        const string n_steps_arg = argv[2];
 
-void parse_input(const string &filename) {
-    ifstream input_file(filename);
+        int64_t n_steps;
+        auto [parse_end, parse_error] = from_chars(n_steps_arg.data(), n_steps_arg.data() + n_steps_arg.size(), n_steps);
+        if (parse_error != errc() || parse_end != n_steps_arg.data() + n_steps_arg.size() || n_steps < 0) {
+            cout << "Invalid number of simulated steps: " << n_steps_arg << endl;
+            return 1;
+        }
+
+        cout << "Flashes after " << n_steps << " steps: " << flash_count_to_string(calculate_flashes(grid, n_steps)) << endl;
+    }
+
+    optional<int64_t> sync_flash_step = calculate_sync_flash_step(grid);
+    if (sync_flash_step) {
+        cout << "Synchronized flash after step: " << *sync_flash_step << endl;
+    }
+    else {
+        cout << "The octopuses never flash in sync" << endl;
+    }
+}
 
+octopus_grid::octopus_grid(istream &input) {
+    vector<string> lines;
     string line;
-    for (size_t i_row = 0; i_row < grid_size; ++i_row) {
-        getline(input_file, line);
-        for (size_t i_col = 0; i_col < grid_size; ++i_col) {
-            g_grid[i_row][i_col] = line[i_col] - '0';
+    while (getline(input, line)) {
+        if (line.empty()) continue;
+        if (!lines.empty() && line.size() != lines[0].size()) throw runtime_error("Grid rows differ in length");
+
+        lines.push_back(line);
+    }
+    if (lines.empty()) throw runtime_error("Empty grid");
+
+    this->_rows = static_cast<int>(lines.size());
+    this->_cols = static_cast<int>(lines[0].size());
+    this->row_words = (this->_cols + 63) / 64;
+    this->last_word_mask = this->_cols % 64 == 0 ? ~uint64_t(0) : (uint64_t(1) << (this->_cols % 64)) - 1;
+
+    for (vector<uint64_t> &plane : this->planes) {
+        plane.assign(static_cast<size_t>(this->_rows * this->row_words), 0);
+    }
+
+    for (size_t i_row = 0; i_row < lines.size(); ++i_row) {
+        for (size_t i_col = 0; i_col < lines[i_row].size(); ++i_col) {
+            int energy = lines[i_row][i_col] - '0';
+            if (energy < 0 || energy > 9) throw runtime_error("Invalid energy level");
+
+            size_t i_word = i_row * static_cast<size_t>(this->row_words) + i_col / 64;
+            for (int k = 0; k < 4; ++k) {
+                this->planes[k][i_word] |= static_cast<uint64_t>((energy >> k) & 1) << (i_col % 64);
+            }
         }
     }
 }
 
-int calculate_sync_flash_step() {
-    for (int step = 1; ; ++step) {
-        if (simulate_step() == 100) {
-            return step;
+int octopus_grid::rows() const {
+    return this->_rows;
+}
+
+int octopus_grid::cols() const {
+    return this->_cols;
+}
+
+int64_t octopus_grid::simulate_step() {
+    const size_t n_words = this->planes[0].size();
+    const size_t row_words = static_cast<size_t>(this->row_words);
+    auto word_mask = [&] (size_t i_word) { return i_word % row_words == row_words - 1 ? this->last_word_mask : ~uint64_t(0); };
+
+    vector<uint64_t> flashed(n_words);
+    vector<uint64_t> flashing(n_words);
+    vector<uint64_t> next_flashing(n_words);
+
+    bool any_flashing = false;
+    for (size_t i_word = 0; i_word < n_words; ++i_word) {
+        this->add_to_word(i_word, word_mask(i_word));
+        flashing[i_word] = flashed[i_word] = this->take_flashing(i_word);
+        any_flashing |= flashing[i_word] != 0;
+    }
+
+    // Every round adds the masks of the octopuses which flashed in the previous round, shifted onto
+    // their neighbours, until no new octopus flashes. The masks are added one at a time, so the
+    // energy levels never exceed 10 and fit into the 4 planes.
+    while (any_flashing) {
+        fill(next_flashing.begin(), next_flashing.end(), 0);
+        any_flashing = false;
+
+        for (int i = 0; i < this->_rows; ++i) {
+            for (int i_source = max(0, i - 1); i_source <= min(this->_rows - 1, i + 1); ++i_source) {
+                const uint64_t *source = flashing.data() + static_cast<size_t>(i_source) * row_words;
+
+                for (size_t w = 0; w < row_words; ++w) {
+                    uint64_t carried_left = w > 0 ? source[w - 1] >> 63 : 0;
+                    uint64_t carried_right = w + 1 < row_words ? source[w + 1] << 63 : 0;
+                    uint64_t neighbour_masks[] = {
+                        (source[w] << 1) | carried_left,
+                        (source[w] >> 1) | carried_right,
+                        i_source != i ? source[w] : 0,
+                    };
+
+                    size_t i_word = static_cast<size_t>(i) * row_words + w;
+                    for (uint64_t neighbours : neighbour_masks) {
+                        this->add_to_word(i_word, neighbours & word_mask(i_word) & ~flashed[i_word]);
+
+                        uint64_t new_flashing = this->take_flashing(i_word);
+                        flashed[i_word] |= new_flashing;
+                        next_flashing[i_word] |= new_flashing;
+                    }
+                    any_flashing |= next_flashing[i_word] != 0;
+                }
+            }
         }
+
+        swap(flashing, next_flashing);
     }
+
+    int64_t flashes = 0;
+    for (uint64_t flashed_word : flashed) {
+        flashes += popcount(flashed_word);
+    }
+
+    return flashes;
+}
+
+uint64_t octopus_grid::state_hash() const {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const vector<uint64_t> &plane : this->planes) {
+        for (uint64_t word : plane) {
+            hash = (hash ^ word) * 0x100000001b3;
+            hash ^= hash >> 29;
+        }
+    }
+
+    return hash;
+}
+
+bool octopus_grid::operator == (const octopus_grid &rhs) const {
+    for (int k = 0; k < 4; ++k) {
+        if (this->planes[k] != rhs.planes[k]) return false;
+    }
+
+    return true;
+}
+
+void octopus_grid::add_to_word(size_t i_word, uint64_t increments) {
+    // ripple-carry adder adding 1 to every column set in increments
+    uint64_t carry = increments;
+    for (vector<uint64_t> &plane : this->planes) {
+        uint64_t next_carry = plane[i_word] & carry;
+        plane[i_word] ^= carry;
+        carry = next_carry;
+    }
+}
+
+uint64_t octopus_grid::take_flashing(size_t i_word) {
+    // energy levels above 9 have the 8 bit and either the 4 or the 2 bit set
+    uint64_t flashing = this->planes[3][i_word] & (this->planes[2][i_word] | this->planes[1][i_word]);
+    for (vector<uint64_t> &plane : this->planes) {
+        plane[i_word] &= ~flashing;
+    }
+
+    return flashing;
 }
 
-int simulate_step() {
-    int flashes = 0;
+optional<cycle_info> simulate(octopus_grid &grid, int64_t max_steps, bool stop_at_sync, vector<int64_t> &step_flashes) {
+    // A repeated state hash only suggests a cycle; it is confirmed by checking that the state repeats
+    // again after the same number of steps, so hash collisions cannot give wrong results.
+    const int64_t grid_size = static_cast<int64_t>(grid.rows()) * grid.cols();
+    unordered_map<uint64_t, int64_t> step_for_hash = {{grid.state_hash(), 0}};
+    optional<octopus_grid> candidate_state;
+    cycle_info candidate_cycle = {0, 0};
+
+    for (int64_t step = 1; step <= max_steps; ++step) {
+        int64_t flashes = grid.simulate_step();
+        step_flashes.push_back(flashes);
+        if (stop_at_sync && flashes == grid_size) return nullopt;
+
+        if (candidate_state && step == candidate_cycle.start + candidate_cycle.length) {
+            if (grid == *candidate_state) return candidate_cycle;
+
+            candidate_state.reset();
+        }
 
-    vector<coord> flashing;
-    for (int i = 0; i < grid_size; ++i) {
-        for (int j = 0; j < grid_size; ++j) {
-            if (++g_grid[i][j] > 9) {
-                g_grid[i][j] = 0;
-                flashing.push_back({i, j});
+        auto [it_seen, inserted] = step_for_hash.try_emplace(grid.state_hash(), step);
+        if (!inserted) {
+            if (!candidate_state) {
+                candidate_state = grid;
+                candidate_cycle = {step, step - it_seen->second};
             }
+            it_seen->second = step;
         }
     }
 
-    auto stimulate = [&flashing] (int i, int j) {
-        if (i < 0 || j < 0 || i >= grid_size || j >= grid_size) return;
-        if (g_grid[i][j] == 0) return;
+    return nullopt;
+}
+
+optional<int64_t> calculate_sync_flash_step(octopus_grid grid) {
+    const int64_t grid_size = static_cast<int64_t>(grid.rows()) * grid.cols();
+    vector<int64_t> step_flashes;
+
+    // without a cycle the simulation only ends at the first synchronized flash
+    if (simulate(grid, numeric_limits<int64_t>::max(), true, step_flashes)) return nullopt;
+    if (step_flashes.back() != grid_size) return nullopt;
+
+    return static_cast<int64_t>(step_flashes.size());
+}
 
-        if (++g_grid[i][j] > 9) {
-            g_grid[i][j] = 0;
-            flashing.push_back({i, j});
+flash_count calculate_flashes(octopus_grid grid, int64_t n_steps) {
+    vector<int64_t> step_flashes;
+    optional<cycle_info> cycle = simulate(grid, n_steps, false, step_flashes);
+
+    flash_count flashes = 0;
+    if (!cycle) {
+        for (int64_t step_flash : step_flashes) {
+            flashes += step_flash;
         }
-    };
 
-    while (!flashing.empty()) {
-        int i = flashing.back().i;
-        int j = flashing.back().j;
-        flashing.pop_back();
-        ++flashes;
+        return flashes;
+    }
+
+    // step_flashes[s - 1] holds the flashes of step s; from step cycle->start + 1 on they repeat
+    auto flashes_of_step = [&] (int64_t step) { return step_flashes[static_cast<size_t>(step - 1)]; };
 
-        stimulate(i - 1, j - 1);
-        stimulate(i - 1, j);
-        stimulate(i - 1, j + 1);
-        stimulate(i, j - 1);
-        stimulate(i, j + 1);
-        stimulate(i + 1, j - 1);
-        stimulate(i + 1, j);
-        stimulate(i + 1, j + 1);
+    int64_t cycle_flashes = 0;
+    for (int64_t step = cycle->start + 1; step <= cycle->start + cycle->length; ++step) {
+        cycle_flashes += flashes_of_step(step);
+    }
+
+    int64_t cycled_steps = n_steps - cycle->start;
+    for (int64_t step = 1; step <= cycle->start; ++step) {
+        flashes += flashes_of_step(step);
+    }
+    flashes += static_cast<flash_count>(cycled_steps / cycle->length) * static_cast<flash_count>(cycle_flashes);
+    for (int64_t step = cycle->start + 1; step <= cycle->start + cycled_steps % cycle->length; ++step) {
+        flashes += flashes_of_step(step);
     }
 
     return flashes;
 }
+
+string flash_count_to_string(flash_count flashes) {
+    string digits;
+    do {
+        digits += static_cast<char>('0' + static_cast<int>(flashes % 10));
+        flashes /= 10;
+    } while (flashes > 0);
+
+    return string(digits.rbegin(), digits.rend());
+}
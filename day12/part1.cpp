@@ -3,25 +3,70 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <bit>
+#include <algorithm>
 #include "string_utils.h"
 
 using namespace std;
 
-struct cave {
-    string name;
-    bool big;
-    bool explored;
+// Caves are interned into dense IDs when the graph is read, with each cave's connections stored as
+// a bitmask of neighbour IDs.
+class cave_graph {
+public:
+    static const int max_caves = 64;
+
+    cave_graph(istream &input);
+
+    int start() const;
+    int end() const;
+    bool big(int i_cave) const;
+    uint64_t neighbours(int i_cave) const;
+    const string &name(int i_cave) const;
+
+private:
+    vector<string> names;
+    vector<uint64_t> adjacency;
+    uint64_t big_caves;
+    int i_start;
+    int i_end;
+
+    int intern(const string &cave_name, unordered_map<string, int> &cave_ids);
 };
 
-const int max_caves = 25;
+// Flat open-addressing table of the path counts already computed for a search state: the current
+// cave, the set of small caves visited so far and whether a small cave was visited twice already.
+class path_count_memo {
+public:
+    struct search_state {
+        uint64_t visited;
+        uint32_t i_cave;
+        bool visited_twice;
+
+        bool operator == (const search_state &rhs) const = default;
+    };
+
+    path_count_memo();
 
-vector<cave> g_caves;
-bool g_conn[max_caves][max_caves];
+    const uint64_t *find(const search_state &state) const;
+    void insert(const search_state &state, uint64_t paths_count);
 
-void parse_input(const string &filename);
-size_t cave_index(const string &cave_name);
-int find_all_paths_count();
-void find_all_paths(size_t i_curr_cave, int &paths_count);
+private:
+    struct entry {
+        search_state state;
+        uint64_t paths_count;
+        bool used;
+    };
+
+    vector<entry> entries;
+    size_t n_used;
+
+    size_t slot_for(const search_state &state) const;
+};
+
+uint64_t find_all_paths_count(const cave_graph &graph);
+uint64_t count_paths(const cave_graph &graph, const path_count_memo::search_state &state, path_count_memo &memo);
+bool next_search_state(const cave_graph &graph, const path_count_memo::search_state &state, int i_to, path_count_memo::search_state &next_state);
 
 
 int main(int argc, char *argv[]) {
@@ -31,58 +76,159 @@ int main(int argc, char *argv[]) {
     }
     const string filename = argv[1];
 
-    parse_input(filename);
+    ifstream input_file(filename);
+    cave_graph graph(input_file);
 
-    cout << "All routes: " << find_all_paths_count() << endl;
+    cout << "All routes: " << find_all_paths_count(graph) << endl;
 }
 
-void parse_input(const string &filename) {
-    ifstream input_file(filename);
+cave_graph::cave_graph(istream &input) {
+    unordered_map<string, int> cave_ids;
+    this->big_caves = 0;
 
     string line;
-    while (getline(input_file, line)) {
+    while (getline(input, line)) {
+        if (line.empty()) continue;
+
         size_t sep_pos = line.find('-');
-        string from = line.substr(0, sep_pos);
-        string to = line.substr(sep_pos + 1);
+        if (sep_pos == string::npos) throw runtime_error("Invalid connection");
+
+        int i_from = this->intern(line.substr(0, sep_pos), cave_ids);
+        int i_to = this->intern(line.substr(sep_pos + 1), cave_ids);
 
-        size_t i_from = cave_index(from);
-        size_t i_to = cave_index(to);
+        if (this->big(i_from) && this->big(i_to)) throw runtime_error("Connected big caves allow infinitely many paths");
 
-        g_conn[i_from][i_to] = g_conn[i_to][i_from] = true;
+        this->adjacency[static_cast<size_t>(i_from)] |= uint64_t(1) << i_to;
+        this->adjacency[static_cast<size_t>(i_to)] |= uint64_t(1) << i_from;
     }
+
+    auto find_id = [&] (const string &cave_name) {
+        auto it = cave_ids.find(cave_name);
+        if (it == cave_ids.end()) throw runtime_error("Missing " + cave_name + " cave");
+        return it->second;
+    };
+    this->i_start = find_id("start");
+    this->i_end = find_id("end");
+}
+
+int cave_graph::start() const {
+    return this->i_start;
+}
+
+int cave_graph::end() const {
+    return this->i_end;
+}
+
+bool cave_graph::big(int i_cave) const {
+    return (this->big_caves >> i_cave) & 1;
+}
+
+uint64_t cave_graph::neighbours(int i_cave) const {
+    return this->adjacency[static_cast<size_t>(i_cave)];
+}
+
+const string &cave_graph::name(int i_cave) const {
+    return this->names[static_cast<size_t>(i_cave)];
+}
+
+int cave_graph::intern(const string &cave_name, unordered_map<string, int> &cave_ids) {
+    auto [it, inserted] = cave_ids.try_emplace(cave_name, static_cast<int>(this->names.size()));
+    if (!inserted) return it->second;
+
+    if (this->names.size() == max_caves) throw runtime_error("Too many caves");
+
+    int i_cave = it->second;
+    this->names.push_back(cave_name);
+    this->adjacency.push_back(0);
+    if (isupper(cave_name[0]) != 0) this->big_caves |= uint64_t(1) << i_cave;
+
+    return i_cave;
 }
 
-size_t cave_index(const string &cave_name) {
-    for (size_t i = 0; i < g_caves.size(); ++i) {
-        if (g_caves[i].name == cave_name) return i;
+uint64_t find_all_paths_count(const cave_graph &graph) {
+    path_count_memo memo;
+    uint32_t i_start = static_cast<uint32_t>(graph.start());
+
+    // no small cave may be visited twice, as if the one allowed second visit was used up already
+    return count_paths(graph, {.visited = uint64_t(1) << i_start, .i_cave = i_start, .visited_twice = true}, memo);
+}
+
+uint64_t count_paths(const cave_graph &graph, const path_count_memo::search_state &state, path_count_memo &memo) {
+    int i_cave = static_cast<int>(state.i_cave);
+    if (i_cave == graph.end()) return 1;
+
+    if (const uint64_t *p_known_count = memo.find(state)) return *p_known_count;
+
+    uint64_t paths_count = 0;
+    uint64_t next_caves = graph.neighbours(i_cave) & ~(uint64_t(1) << graph.start());
+    for (; next_caves != 0; next_caves &= next_caves - 1) {
+        int i_to = countr_zero(next_caves);
+
+        path_count_memo::search_state next_state;
+        if (next_search_state(graph, state, i_to, next_state)) {
+            paths_count += count_paths(graph, next_state, memo);
+        }
     }
 
-    g_caves.push_back({.name = cave_name, .big = isupper(cave_name[0]) != 0, .explored = false});
-    return g_caves.size() - 1;
+    memo.insert(state, paths_count);
+    return paths_count;
 }
 
-int find_all_paths_count() {
-    int n_paths = 0;
-    size_t i_start = cave_index("start");
+bool next_search_state(const cave_graph &graph, const path_count_memo::search_state &state, int i_to, path_count_memo::search_state &next_state) {
+    next_state = {.visited = state.visited, .i_cave = static_cast<uint32_t>(i_to), .visited_twice = state.visited_twice};
+    if (graph.big(i_to)) return true;
+
+    uint64_t cave_bit = uint64_t(1) << i_to;
+    if (!(state.visited & cave_bit)) {
+        next_state.visited |= cave_bit;
+        return true;
+    }
+    if (!state.visited_twice) {
+        next_state.visited_twice = true;
+        return true;
+    }
 
-    find_all_paths(i_start, n_paths);
+    return false;
+}
 
-    return n_paths;
+path_count_memo::path_count_memo() {
+    this->entries.resize(1024);
+    this->n_used = 0;
 }
 
-void find_all_paths(size_t i_curr_cave, int &paths_count) {
-    if (g_caves[i_curr_cave].name == "end") {
-        ++paths_count;
-        return;
+const uint64_t *path_count_memo::find(const search_state &state) const {
+    for (size_t slot = this->slot_for(state); this->entries[slot].used; slot = (slot + 1) % this->entries.size()) {
+        if (this->entries[slot].state == state) return &this->entries[slot].paths_count;
     }
 
-    if (!g_caves[i_curr_cave].big) g_caves[i_curr_cave].explored = true;
+    return nullptr;
+}
+
+void path_count_memo::insert(const search_state &state, uint64_t paths_count) {
+    // keep the table at most half full, rehashing into twice the size when needed
+    if (2 * (this->n_used + 1) > this->entries.size()) {
+        vector<entry> old_entries(this->entries.size() * 2);
+        swap(old_entries, this->entries);
+        this->n_used = 0;
 
-    for (size_t i_to = 0; i_to < max_caves; ++i_to) {
-        if (g_conn[i_curr_cave][i_to] && !g_caves[i_to].explored) {
-            find_all_paths(i_to, paths_count);
+        for (const entry &entry : old_entries) {
+            if (entry.used) this->insert(entry.state, entry.paths_count);
         }
     }
 
-    g_caves[i_curr_cave].explored = false;
+    size_t slot = this->slot_for(state);
+    while (this->entries[slot].used) {
+        slot = (slot + 1) % this->entries.size();
+    }
+
+    this->entries[slot] = {.state = state, .paths_count = paths_count, .used = true};
+    ++this->n_used;
+}
+
+size_t path_count_memo::slot_for(const search_state &state) const {
+    uint64_t hash = state.visited * 0x9e3779b97f4a7c15;
+    hash ^= (static_cast<uint64_t>(state.i_cave) << 1 | state.visited_twice) * 0xc2b2ae3d27d4eb4f;
+    hash ^= hash >> 31;
+
+    return static_cast<size_t>(hash) & (this->entries.size() - 1);
 }
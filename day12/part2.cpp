@@ -3,100 +3,379 @@
 #include <sstream>
 #include <string>
 #include <vector>
-#include <set>
+#include <unordered_map>
+#include <bit>
+#include <algorithm>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <exception>
 #include "string_utils.h"
 
 using namespace std;
 
-struct cave {
-    string name;
-    int times_visited;
-    int max_visits;
+// Caves are interned into dense IDs when the graph is read, with each cave's connections stored as
+// a bitmask of neighbour IDs.
+class cave_graph {
+public:
+    static const int max_caves = 64;
+
+    cave_graph(istream &input);
+
+    int start() const;
+    int end() const;
+    bool big(int i_cave) const;
+    uint64_t neighbours(int i_cave) const;
+    const string &name(int i_cave) const;
+
+private:
+    vector<string> names;
+    vector<uint64_t> adjacency;
+    uint64_t big_caves;
+    int i_start;
+    int i_end;
+
+    int intern(const string &cave_name, unordered_map<string, int> &cave_ids);
 };
 
-const int max_caves = 25;
+// Flat open-addressing table of the path counts already computed for a search state: the current
+// cave, the set of small caves visited so far and whether a small cave was visited twice already.
+class path_count_memo {
+public:
+    struct search_state {
+        uint64_t visited;
+        uint32_t i_cave;
+        bool visited_twice;
+
+        bool operator == (const search_state &rhs) const = default;
+    };
+
+    path_count_memo();
 
-vector<cave> g_caves;
-bool g_conn[max_caves][max_caves];
+    const uint64_t *find(const search_state &state) const;
+    void insert(const search_state &state, uint64_t paths_count);
 
-void parse_input(const string &filename);
-size_t cave_index(const string &cave_name);
-size_t find_all_paths_count();
-void find_all_paths(size_t i_curr_cave, vector<string> &curr_path, set<string> &all_paths);
+private:
+    struct entry {
+        search_state state;
+        uint64_t paths_count;
+        bool used;
+    };
+
+    vector<entry> entries;
+    size_t n_used;
+
+    size_t slot_for(const search_state &state) const;
+};
+
+// A partially explored path, handed to a worker thread to enumerate all of its completions.
+struct path_task {
+    path_count_memo::search_state state;
+    vector<int> path;
+};
+
+// Paths enumerated by one thread, stored back to back in the thread's own arena.
+struct path_list {
+    string arena;
+    vector<pair<size_t, size_t>> path_spans;
+};
+
+uint64_t find_all_paths_count(const cave_graph &graph);
+uint64_t count_paths(const cave_graph &graph, const path_count_memo::search_state &state, path_count_memo &memo);
+vector<string_view> find_all_paths(const cave_graph &graph, unsigned n_threads, vector<path_list> &lists);
+void split_paths(const cave_graph &graph, path_task &task, int depth, vector<path_task> &tasks, path_list &list);
+void enumerate_paths(const cave_graph &graph, path_task &task, path_list &list);
+bool next_search_state(const cave_graph &graph, const path_count_memo::search_state &state, int i_to, path_count_memo::search_state &next_state);
+void add_path(const cave_graph &graph, const vector<int> &path, path_list &list);
 
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        cout << "Usage: <exe> <filename>\n";
+        cout << "Usage: <exe> <filename> [--list]\n";
         return 1;
     }
     const string filename = argv[1];
 
-    parse_input(filename);
+    ifstream input_file(filename);
+    cave_graph graph(input_file);
+
+    if (argc >= 3 && string(argv[2]) == "--list") {
+        vector<path_list> lists;
+        for (string_view path : find_all_paths(graph, max(1u, thread::hardware_concurrency()), lists)) {
+            cout << path << '\n';
+        }
+    }
 
-    cout << "All routes: " << find_all_paths_count() << endl;
+    cout << "All routes: " << find_all_paths_count(graph) << endl;
 }
 
-void parse_input(const string &filename) {
-    ifstream input_file(filename);
+cave_graph::cave_graph(istream &input) {
+    unordered_map<string, int> cave_ids;
+    this->big_caves = 0;
 
     string line;
-    while (getline(input_file, line)) {
+    while (getline(input, line)) {
+        if (line.empty()) continue;
+
         size_t sep_pos = line.find('-');
-        string from = line.substr(0, sep_pos);
-        string to = line.substr(sep_pos + 1);
+        if (sep_pos == string::npos) throw runtime_error("Invalid connection");
+
+        int i_from = this->intern(line.substr(0, sep_pos), cave_ids);
+        int i_to = this->intern(line.substr(sep_pos + 1), cave_ids);
 
-        size_t i_from = cave_index(from);
-        size_t i_to = cave_index(to);
+        if (this->big(i_from) && this->big(i_to)) throw runtime_error("Connected big caves allow infinitely many paths");
 
-        g_conn[i_from][i_to] = g_conn[i_to][i_from] = true;
+        this->adjacency[static_cast<size_t>(i_from)] |= uint64_t(1) << i_to;
+        this->adjacency[static_cast<size_t>(i_to)] |= uint64_t(1) << i_from;
     }
+
+    auto find_id = [&] (const string &cave_name) {
+        auto it = cave_ids.find(cave_name);
+        if (it == cave_ids.end()) throw runtime_error("Missing " + cave_name + " cave");
+        return it->second;
+    };
+    this->i_start = find_id("start");
+    this->i_end = find_id("end");
 }
 
-size_t cave_index(const string &cave_name) {
-    for (size_t i = 0; i < g_caves.size(); ++i) {
-        if (g_caves[i].name == cave_name) return i;
-    }
+int cave_graph::start() const {
+    return this->i_start;
+}
+
+int cave_graph::end() const {
+    return this->i_end;
+}
+
+bool cave_graph::big(int i_cave) const {
+    return (this->big_caves >> i_cave) & 1;
+}
+
+uint64_t cave_graph::neighbours(int i_cave) const {
+    return this->adjacency[static_cast<size_t>(i_cave)];
+}
+
+const string &cave_graph::name(int i_cave) const {
+    return this->names[static_cast<size_t>(i_cave)];
+}
+
+int cave_graph::intern(const string &cave_name, unordered_map<string, int> &cave_ids) {
+    auto [it, inserted] = cave_ids.try_emplace(cave_name, static_cast<int>(this->names.size()));
+    if (!inserted) return it->second;
+
+    if (this->names.size() == max_caves) throw runtime_error("Too many caves");
+
+    int i_cave = it->second;
+    this->names.push_back(cave_name);
+    this->adjacency.push_back(0);
+    if (isupper(cave_name[0]) != 0) this->big_caves |= uint64_t(1) << i_cave;
 
-    cave cave = {.name = cave_name, .times_visited = 0, .max_visits = 1};
-    if (isupper(cave_name[0]) != 0) {
-        cave.max_visits = numeric_limits<decltype(cave.max_visits)>::max();
+    return i_cave;
+}
+
+uint64_t find_all_paths_count(const cave_graph &graph) {
+    path_count_memo memo;
+    uint32_t i_start = static_cast<uint32_t>(graph.start());
+
+    return count_paths(graph, {.visited = uint64_t(1) << i_start, .i_cave = i_start, .visited_twice = false}, memo);
+}
+
+uint64_t count_paths(const cave_graph &graph, const path_count_memo::search_state &state, path_count_memo &memo) {
+    int i_cave = static_cast<int>(state.i_cave);
+    if (i_cave == graph.end()) return 1;
+
+    if (const uint64_t *p_known_count = memo.find(state)) return *p_known_count;
+
+    uint64_t paths_count = 0;
+    uint64_t next_caves = graph.neighbours(i_cave) & ~(uint64_t(1) << graph.start());
+    for (; next_caves != 0; next_caves &= next_caves - 1) {
+        int i_to = countr_zero(next_caves);
+
+        path_count_memo::search_state next_state;
+        if (next_search_state(graph, state, i_to, next_state)) {
+            paths_count += count_paths(graph, next_state, memo);
+        }
     }
-    g_caves.push_back(cave);
-    return g_caves.size() - 1;
+
+    memo.insert(state, paths_count);
+    return paths_count;
 }
 
-size_t find_all_paths_count() {
-    vector<string> curr_path;
-    set<string> all_paths;
-    size_t i_start = cave_index("start");
+vector<string_view> find_all_paths(const cave_graph &graph, unsigned n_threads, vector<path_list> &lists) {
+    // The search is split into independent subtrees at a fixed depth. Worker threads pick the
+    // subtrees off a shared counter and write the paths into their own lists; each list is sorted
+    // by its thread and the sorted lists are merged at the end.
+    const int split_depth = 4;
+
+    lists.assign(n_threads + 1, path_list());
+    path_list &short_paths = lists.back();
 
-    for (size_t i = 0; i < g_caves.size(); ++i) {
-        if (g_caves[i].max_visits == 1 && g_caves[i].name != "start" && g_caves[i].name != "end") {
-            g_caves[i].max_visits = 2;
-            find_all_paths(i_start, curr_path, all_paths);
-            g_caves[i].max_visits = 1;
+    int i_start = graph.start();
+    path_task root = {{.visited = uint64_t(1) << i_start, .i_cave = static_cast<uint32_t>(i_start), .visited_twice = false}, {i_start}};
+    vector<path_task> tasks;
+    split_paths(graph, root, split_depth, tasks, short_paths);
+
+    atomic<size_t> next_task = 0;
+    vector<vector<string_view>> sorted_paths(lists.size());
+    auto sort_list = [&] (size_t i_list) {
+        const path_list &list = lists[i_list];
+        for (auto [offset, length] : list.path_spans) {
+            sorted_paths[i_list].push_back(string_view(list.arena).substr(offset, length));
+        }
+        sort(sorted_paths[i_list].begin(), sorted_paths[i_list].end());
+    };
+
+    // the errors of the workers and of the calling thread, which sorts the short paths meanwhile;
+    // a failing thread takes the remaining tasks off the counter, so that the others stop early
+    vector<exception_ptr> thread_errors(n_threads + 1);
+    auto run_capturing_errors = [&] (size_t i_list, auto &&work) {
+        try {
+            work();
         }
+        catch (...) {
+            thread_errors[i_list] = current_exception();
+            next_task = tasks.size();
+        }
+    };
+
+    vector<thread> threads;
+    for (unsigned i_thread = 0; i_thread < n_threads; ++i_thread) {
+        threads.emplace_back([&, i_thread] () {
+            run_capturing_errors(i_thread, [&] () {
+                for (size_t i_task; (i_task = next_task++) < tasks.size();) {
+                    enumerate_paths(graph, tasks[i_task], lists[i_thread]);
+                }
+                sort_list(i_thread);
+            });
+        });
+    }
+    run_capturing_errors(n_threads, [&] () { sort_list(n_threads); });
+    for (thread &thread : threads) {
+        thread.join();
     }
+    for (const exception_ptr &thread_error : thread_errors) {
+        if (thread_error) rethrow_exception(thread_error);
+    }
+
+    vector<string_view> all_paths;
+    for (const vector<string_view> &paths : sorted_paths) {
+        size_t merged_size = all_paths.size();
+        all_paths.insert(all_paths.end(), paths.begin(), paths.end());
+        inplace_merge(all_paths.begin(), all_paths.begin() + static_cast<ptrdiff_t>(merged_size), all_paths.end());
+    }
+    all_paths.erase(unique(all_paths.begin(), all_paths.end()), all_paths.end());
 
-    return all_paths.size();
+    return all_paths;
 }
 
-void find_all_paths(size_t i_curr_cave, vector<string> &curr_path, set<string> &all_paths) {
-    if (g_caves[i_curr_cave].name == "end") {
-        all_paths.insert(join(curr_path, ",") + ",end");
+void split_paths(const cave_graph &graph, path_task &task, int depth, vector<path_task> &tasks, path_list &list) {
+    int i_cave = static_cast<int>(task.state.i_cave);
+    if (i_cave == graph.end()) {
+        add_path(graph, task.path, list);
+        return;
+    }
+    if (depth == 0) {
+        tasks.push_back(task);
         return;
     }
 
-    ++g_caves[i_curr_cave].times_visited;
-    curr_path.push_back(g_caves[i_curr_cave].name);
+    uint64_t next_caves = graph.neighbours(i_cave) & ~(uint64_t(1) << graph.start());
+    for (; next_caves != 0; next_caves &= next_caves - 1) {
+        int i_to = countr_zero(next_caves);
 
-    for (size_t i_to = 0; i_to < max_caves; ++i_to) {
-        if (g_conn[i_curr_cave][i_to] && g_caves[i_to].times_visited < g_caves[i_to].max_visits) {
-            find_all_paths(i_to, curr_path, all_paths);
+        path_task next_task = {.state = {}, .path = task.path};
+        if (next_search_state(graph, task.state, i_to, next_task.state)) {
+            next_task.path.push_back(i_to);
+            split_paths(graph, next_task, depth - 1, tasks, list);
         }
     }
+}
+
+void enumerate_paths(const cave_graph &graph, path_task &task, path_list &list) {
+    int i_cave = static_cast<int>(task.state.i_cave);
+    if (i_cave == graph.end()) {
+        add_path(graph, task.path, list);
+        return;
+    }
+
+    path_count_memo::search_state state = task.state;
+    uint64_t next_caves = graph.neighbours(i_cave) & ~(uint64_t(1) << graph.start());
+    for (; next_caves != 0; next_caves &= next_caves - 1) {
+        int i_to = countr_zero(next_caves);
+
+        if (next_search_state(graph, state, i_to, task.state)) {
+            task.path.push_back(i_to);
+            enumerate_paths(graph, task, list);
+            task.path.pop_back();
+        }
+    }
+    task.state = state;
+}
+
+bool next_search_state(const cave_graph &graph, const path_count_memo::search_state &state, int i_to, path_count_memo::search_state &next_state) {
+    next_state = {.visited = state.visited, .i_cave = static_cast<uint32_t>(i_to), .visited_twice = state.visited_twice};
+    if (graph.big(i_to)) return true;
+
+    uint64_t cave_bit = uint64_t(1) << i_to;
+    if (!(state.visited & cave_bit)) {
+        next_state.visited |= cave_bit;
+        return true;
+    }
+    if (!state.visited_twice) {
+        next_state.visited_twice = true;
+        return true;
+    }
+
+    return false;
+}
+
+void add_path(const cave_graph &graph, const vector<int> &path, path_list &list) {
+    size_t offset = list.arena.size();
+    for (size_t i = 0; i < path.size(); ++i) {
+        if (i > 0) list.arena += ',';
+        list.arena += graph.name(path[i]);
+    }
+
+    list.path_spans.push_back({offset, list.arena.size() - offset});
+}
+
+path_count_memo::path_count_memo() {
+    this->entries.resize(1024);
+    this->n_used = 0;
+}
+
+const uint64_t *path_count_memo::find(const search_state &state) const {
+    for (size_t slot = this->slot_for(state); this->entries[slot].used; slot = (slot + 1) % this->entries.size()) {
+        if (this->entries[slot].state == state) return &this->entries[slot].paths_count;
+    }
+
+    return nullptr;
+}
+
+void path_count_memo::insert(const search_state &state, uint64_t paths_count) {
+    // keep the table at most half full, rehashing into twice the size when needed
+    if (2 * (this->n_used + 1) > this->entries.size()) {
+        vector<entry> old_entries(this->entries.size() * 2);
+        swap(old_entries, this->entries);
+        this->n_used = 0;
+
+        for (const entry &entry : old_entries) {
+            if (entry.used) this->insert(entry.state, entry.paths_count);
+        }
+    }
+
+    size_t slot = this->slot_for(state);
+    while (this->entries[slot].used) {
+        slot = (slot + 1) % this->entries.size();
+    }
+
+    this->entries[slot] = {.state = state, .paths_count = paths_count, .used = true};
+    ++this->n_used;
+}
+
+size_t path_count_memo::slot_for(const search_state &state) const {
+    uint64_t hash = state.visited * 0x9e3779b97f4a7c15;
+    hash ^= (static_cast<uint64_t>(state.i_cave) << 1 | state.visited_twice) * 0xc2b2ae3d27d4eb4f;
+    hash ^= hash >> 31;
 
-    --g_caves[i_curr_cave].times_visited;
-    curr_path.pop_back();
+    return static_cast<size_t>(hash) & (this->entries.size() - 1);
 }
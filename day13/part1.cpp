@@ -2,6 +2,8 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <tuple>
+#include <algorithm>
 #include "string_utils.h"
 
 using namespace std;
@@ -9,6 +11,8 @@ using namespace std;
 struct point {
     int x;
     int y;
+
+    auto operator <=> (const point &rhs) const = default;
 };
 
 struct fold_instruction {
@@ -16,17 +20,8 @@ struct fold_instruction {
     int coord;
 };
 
-const int max_x = 1311;
-const int max_y = 894;
-int g_size_x, g_size_y;
-bool g_dots[max_x][max_y];
-
-vector<fold_instruction> parse_input(const string &filename);
-void fold(fold_instruction instruction);
-void fold_left(int fold_line_coord);
-void fold_up(int fold_line_coord);
-int count_dots();
-void print_dots();
+tuple<vector<point>, vector<fold_instruction>> parse_input(const string &filename);
+vector<point> fold(const vector<point> &dots, const vector<fold_instruction> &instructions);
 
 
 int main(int argc, char *argv[]) {
@@ -36,15 +31,17 @@ int main(int argc, char *argv[]) {
     }
     const string filename = argv[1];
 
-    vector<fold_instruction> instructions = parse_input(filename);
+    auto [dots, instructions] = parse_input(filename);
+    if (instructions.empty()) throw runtime_error("No fold instructions");
 
-    fold(instructions[0]);
+    vector<point> folded_dots = fold(dots, {instructions[0]});
 
-    cout << "Dots visible: " << count_dots() << endl;
+    cout << "Dots visible: " << folded_dots.size() << endl;
 }
 
-vector<fold_instruction> parse_input(const string &filename) {
+tuple<vector<point>, vector<fold_instruction>> parse_input(const string &filename) {
     ifstream input_file(filename);
+    vector<point> dots;
     vector<fold_instruction> instructions;
 
     string line;
@@ -54,10 +51,9 @@ vector<fold_instruction> parse_input(const string &filename) {
 
         int x, y;
         istringstream(line) >> x >> expect(",") >> y;
+        if (x < 0 || y < 0) throw runtime_error("Invalid dot");
 
-        g_dots[x][y] = true;
-        if (g_size_x <= x) g_size_x = x + 1;
-        if (g_size_y <= y) g_size_y = y + 1;
+        dots.push_back({x, y});
     }
 
     while (getline(input_file, line)) {
@@ -68,55 +64,36 @@ vector<fold_instruction> parse_input(const string &filename) {
         instructions.push_back({(axis == 'x' ? fold_instruction::x : fold_instruction::y), coord});
     }
 
-    return instructions;
-}
-
-void fold(fold_instruction instruction) {
-    if (instruction.axis == fold_instruction::x) {
-        fold_left(instruction.coord);
-    }
-    else {
-        fold_up(instruction.coord);
-    }
-}
-
-void fold_left(int fold_line_coord) {
-    for (int x1 = fold_line_coord - 1, x2 = fold_line_coord + 1; x1 >= 0 && x2 < g_size_x; --x1, ++x2) {
-        for (int y = 0; y < g_size_y; ++y) {
-            g_dots[x1][y] = g_dots[x1][y] || g_dots[x2][y];
-        }
-    }
-
-    g_size_x = fold_line_coord;
+    return {dots, instructions};
 }
 
-void fold_up(int fold_line_coord) {
-    for (int y1 = fold_line_coord - 1, y2 = fold_line_coord + 1; y1 >= 0 && y2 < g_size_y; --y1, ++y2) {
-        for (int x = 0; x < g_size_x; ++x) {
-            g_dots[x][y1] = g_dots[x][y1] || g_dots[x][y2];
-        }
+vector<point> fold(const vector<point> &dots, const vector<fold_instruction> &instructions) {
+    // The folds along each axis only ever move the dots' coordinates along that axis, so every dot
+    // is mapped through all the folds at once and the overlapping dots are merged at the end.
+    // Like on paper, dots on a fold line or folded past the sheet's edge disappear.
+    vector<int> x_folds, y_folds;
+    for (fold_instruction instruction : instructions) {
+        (instruction.axis == fold_instruction::x ? x_folds : y_folds).push_back(instruction.coord);
     }
 
-    g_size_y = fold_line_coord;
-}
-
-int count_dots() {
-    int dots = 0;
-
-    for (int y = 0; y < g_size_y; ++y) {
-        for (int x = 0; x < g_size_x; ++x) {
-             if (g_dots[x][y]) ++dots;
+    auto fold_coord = [] (int coord, const vector<int> &folds) {
+        for (int fold_line_coord : folds) {
+            if (coord == fold_line_coord) return -1;
+            if (coord > fold_line_coord) coord = 2 * fold_line_coord - coord;
+            if (coord < 0) return -1;
         }
+        return coord;
+    };
+
+    vector<point> folded_dots;
+    folded_dots.reserve(dots.size());
+    for (point dot : dots) {
+        point folded_dot = {fold_coord(dot.x, x_folds), fold_coord(dot.y, y_folds)};
+        if (folded_dot.x >= 0 && folded_dot.y >= 0) folded_dots.push_back(folded_dot);
     }
 
-    return dots;
-}
+    sort(folded_dots.begin(), folded_dots.end());
+    folded_dots.erase(unique(folded_dots.begin(), folded_dots.end()), folded_dots.end());
 
-void print_dots() {
-    for (int y = 0; y < g_size_y; ++y) {
-        for (int x = 0; x < g_size_x; ++x) {
-            cout << (g_dots[x][y] ? '#' : '.');
-        }
-        cout << endl;
-    }
+    return folded_dots;
 }
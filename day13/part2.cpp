@@ -2,6 +2,9 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <tuple>
+#include <algorithm>
+#include <bit>
 #include "string_utils.h"
 
 using namespace std;
@@ -9,6 +12,8 @@ using namespace std;
 struct point {
     int x;
     int y;
+
+    auto operator <=> (const point &rhs) const = default;
 };
 
 struct fold_instruction {
@@ -16,37 +21,104 @@ struct fold_instruction {
     int coord;
 };
 
-const int max_x = 1311;
-const int max_y = 894;
-int g_size_x, g_size_y;
-bool g_dots[max_x][max_y];
+// Bit-packed row-major sheet: bit x % 64 of word x / 64 of row y is set if there is a dot at
+// (x, y). Rows keep their initial stride when the sheet is folded.
+class dot_sheet {
+public:
+    dot_sheet(int size_x, int size_y);
+
+    int size_x() const;
+    int size_y() const;
+    bool at(int x, int y) const;
+    void set(int x, int y);
+
+    void fold(fold_instruction instruction);
+    void fold_left(int fold_line_coord);
+    void fold_up(int fold_line_coord);
+    int64_t count_dots() const;
+
+private:
+    vector<uint64_t> words;
+    size_t row_stride;
+    int _size_x;
+    int _size_y;
+
+    uint64_t *row(int y);
+    const uint64_t *row(int y) const;
+    size_t active_row_words() const;
+    void extend(int size_x, int size_y);
+};
+
+// The folded sheet spells a code in a 4x6 letter font, with one empty column after each letter.
+// A letter's glyph is packed row by row into 24 bits, the top left cell being the highest bit.
+const int letter_size_x = 4;
+const int letter_size_y = 6;
+
+struct letter_glyph {
+    char letter;
+    uint32_t mask;
+};
+
+constexpr letter_glyph make_glyph(char letter, const char (&rows)[letter_size_x * letter_size_y + 1]) {
+    uint32_t mask = 0;
+    for (int i = 0; i < letter_size_x * letter_size_y; ++i) {
+        mask = mask << 1 | (rows[i] == '#' ? 1 : 0);
+    }
+
+    return {letter, mask};
+}
+
+constexpr letter_glyph g_letter_glyphs[] = {
+    make_glyph('A', ".##." "#..#" "#..#" "####" "#..#" "#..#"),
+    make_glyph('B', "###." "#..#" "###." "#..#" "#..#" "###."),
+    make_glyph('C', ".##." "#..#" "#..." "#..." "#..#" ".##."),
+    make_glyph('E', "####" "#..." "###." "#..." "#..." "####"),
+    make_glyph('F', "####" "#..." "###." "#..." "#..." "#..."),
+    make_glyph('G', ".##." "#..#" "#..." "#.##" "#..#" ".###"),
+    make_glyph('H', "#..#" "#..#" "####" "#..#" "#..#" "#..#"),
+    make_glyph('J', "..##" "...#" "...#" "...#" "#..#" ".##."),
+    make_glyph('K', "#..#" "#.#." "##.." "#.#." "#.#." "#..#"),
+    make_glyph('L', "#..." "#..." "#..." "#..." "#..." "####"),
+    make_glyph('O', ".##." "#..#" "#..#" "#..#" "#..#" ".##."),
+    make_glyph('P', "###." "#..#" "#..#" "###." "#..." "#..."),
+    make_glyph('R', "###." "#..#" "#..#" "###." "#.#." "#..#"),
+    make_glyph('S', ".###" "#..." "#..." ".##." "...#" "###."),
+    make_glyph('U', "#..#" "#..#" "#..#" "#..#" "#..#" ".##."),
+    make_glyph('Z', "####" "...#" "..#." ".#.." "#..." "####"),
+};
 
-vector<fold_instruction> parse_input(const string &filename);
-void fold(fold_instruction instruction);
-void fold_left(int fold_line_coord);
-void fold_up(int fold_line_coord);
-int count_dots();
-void print_dots();
+tuple<vector<point>, vector<fold_instruction>> parse_input(const string &filename);
+vector<point> fold(const vector<point> &dots, const vector<fold_instruction> &instructions);
+dot_sheet fold_to_sheet(const vector<point> &dots, const vector<fold_instruction> &instructions);
+void print_dots(const dot_sheet &sheet);
+string recognize_code(const dot_sheet &sheet);
+uint64_t reverse_bits(uint64_t word);
 
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        cout << "Usage: <exe> <filename>\n";
+        cout << "Usage: <exe> <filename> [--print]\n";
         return 1;
     }
     const string filename = argv[1];
 
-    vector<fold_instruction> instructions = parse_input(filename);
+    auto [dots, instructions] = parse_input(filename);
 
-    for (fold_instruction i : instructions) {
-        fold(i);
-    }
+    dot_sheet sheet = fold_to_sheet(dots, instructions);
+
+    cout << "Dots visible: " << sheet.count_dots() << endl;
+    string code = recognize_code(sheet);
+    cout << "Code: " << code << endl;
 
-    print_dots();
+    // fall back to printing the sheet when some letters could not be recognized
+    if ((argc >= 3 && string(argv[2]) == "--print") || code.find('?') != string::npos) {
+        print_dots(sheet);
+    }
 }
 
-vector<fold_instruction> parse_input(const string &filename) {
+tuple<vector<point>, vector<fold_instruction>> parse_input(const string &filename) {
     ifstream input_file(filename);
+    vector<point> dots;
     vector<fold_instruction> instructions;
 
     string line;
@@ -56,10 +128,9 @@ vector<fold_instruction> parse_input(const string &filename) {
 
         int x, y;
         istringstream(line) >> x >> expect(",") >> y;
+        if (x < 0 || y < 0) throw runtime_error("Invalid dot");
 
-        g_dots[x][y] = true;
-        if (g_size_x <= x) g_size_x = x + 1;
-        if (g_size_y <= y) g_size_y = y + 1;
+        dots.push_back({x, y});
     }
 
     while (getline(input_file, line)) {
@@ -70,55 +141,269 @@ vector<fold_instruction> parse_input(const string &filename) {
         instructions.push_back({(axis == 'x' ? fold_instruction::x : fold_instruction::y), coord});
     }
 
-    return instructions;
+    return {dots, instructions};
+}
+
+vector<point> fold(const vector<point> &dots, const vector<fold_instruction> &instructions) {
+    // The folds along each axis only ever move the dots' coordinates along that axis, so every dot
+    // is mapped through all the folds at once and the overlapping dots are merged at the end.
+    // Like on paper, dots on a fold line or folded past the sheet's edge disappear.
+    vector<int> x_folds, y_folds;
+    for (fold_instruction instruction : instructions) {
+        (instruction.axis == fold_instruction::x ? x_folds : y_folds).push_back(instruction.coord);
+    }
+
+    auto fold_coord = [] (int coord, const vector<int> &folds) {
+        for (int fold_line_coord : folds) {
+            if (coord == fold_line_coord) return -1;
+            if (coord > fold_line_coord) coord = 2 * fold_line_coord - coord;
+            if (coord < 0) return -1;
+        }
+        return coord;
+    };
+
+    vector<point> folded_dots;
+    folded_dots.reserve(dots.size());
+    for (point dot : dots) {
+        point folded_dot = {fold_coord(dot.x, x_folds), fold_coord(dot.y, y_folds)};
+        if (folded_dot.x >= 0 && folded_dot.y >= 0) folded_dots.push_back(folded_dot);
+    }
+
+    sort(folded_dots.begin(), folded_dots.end());
+    folded_dots.erase(unique(folded_dots.begin(), folded_dots.end()), folded_dots.end());
+
+    return folded_dots;
+}
+
+dot_sheet fold_to_sheet(const vector<point> &dots, const vector<fold_instruction> &instructions) {
+    int size_x = 0, size_y = 0;
+    for (point dot : dots) {
+        size_x = max(size_x, dot.x + 1);
+        size_y = max(size_y, dot.y + 1);
+    }
+
+    // dense sheets are folded as bitmaps, as long as the bitmap is no bigger than the list of dots;
+    // sparse sheets are folded as points and only the folded result is turned into a bitmap
+    uint64_t bitmap_words = (static_cast<uint64_t>(size_x) + 63) / 64 * static_cast<uint64_t>(size_y);
+    if (bitmap_words <= dots.size()) {
+        dot_sheet sheet(size_x, size_y);
+        for (point dot : dots) {
+            sheet.set(dot.x, dot.y);
+        }
+        for (fold_instruction instruction : instructions) {
+            sheet.fold(instruction);
+        }
+
+        return sheet;
+    }
+
+    // the folded sheet ends at the last fold line along each axis
+    for (fold_instruction instruction : instructions) {
+        (instruction.axis == fold_instruction::x ? size_x : size_y) = instruction.coord;
+    }
+
+    dot_sheet sheet(size_x, size_y);
+    for (point dot : fold(dots, instructions)) {
+        sheet.set(dot.x, dot.y);
+    }
+
+    return sheet;
 }
 
-void fold(fold_instruction instruction) {
+dot_sheet::dot_sheet(int size_x, int size_y) {
+    if (size_x < 0 || size_y < 0) throw runtime_error("Invalid sheet size");
+
+    this->_size_x = size_x;
+    this->_size_y = size_y;
+    this->row_stride = (static_cast<size_t>(size_x) + 63) / 64;
+    this->words.assign(this->row_stride * static_cast<size_t>(size_y), 0);
+}
+
+int dot_sheet::size_x() const {
+    return this->_size_x;
+}
+
+int dot_sheet::size_y() const {
+    return this->_size_y;
+}
+
+bool dot_sheet::at(int x, int y) const {
+    return (this->row(y)[x / 64] >> (x % 64)) & 1;
+}
+
+void dot_sheet::set(int x, int y) {
+    if (x < 0 || y < 0 || x >= this->_size_x || y >= this->_size_y) throw runtime_error("Dot outside the sheet");
+
+    this->row(y)[x / 64] |= uint64_t(1) << (x % 64);
+}
+
+void dot_sheet::fold(fold_instruction instruction) {
     if (instruction.axis == fold_instruction::x) {
-        fold_left(instruction.coord);
+        this->fold_left(instruction.coord);
     }
     else {
-        fold_up(instruction.coord);
+        this->fold_up(instruction.coord);
     }
 }
 
-void fold_left(int fold_line_coord) {
-    for (int x1 = fold_line_coord - 1, x2 = fold_line_coord + 1; x1 >= 0 && x2 < g_size_x; --x1, ++x2) {
-        for (int y = 0; y < g_size_y; ++y) {
-            g_dots[x1][y] = g_dots[x1][y] || g_dots[x2][y];
+void dot_sheet::fold_left(int fold_line_coord) {
+    if (fold_line_coord < 0) throw runtime_error("Fold line outside the sheet");
+    if (fold_line_coord >= this->_size_x) {
+        // no dots lie on or past the fold line, the sheet just ends there
+        this->extend(fold_line_coord, this->_size_y);
+        return;
+    }
+
+    // Reversing a row of n words maps bit x to bit 64n - 1 - x; shifting that down by
+    // 64n - 1 - 2 * fold_line_coord moves it onto its mirror image 2 * fold_line_coord - x. Mirrored
+    // bits pushed out of the row are folded past the sheet's edge and disappear.
+    const size_t n_words = this->active_row_words();
+    const int64_t shift = static_cast<int64_t>(n_words) * 64 - 1 - 2 * static_cast<int64_t>(fold_line_coord);
+    const size_t word_shift = static_cast<size_t>(abs(shift)) / 64;
+    const unsigned bit_shift = static_cast<unsigned>(abs(shift) % 64);
+
+    const size_t folded_words = (static_cast<size_t>(fold_line_coord) + 63) / 64;
+    const uint64_t last_word_mask = fold_line_coord % 64 == 0 ? ~uint64_t(0) : (uint64_t(1) << (fold_line_coord % 64)) - 1;
+
+    vector<uint64_t> reversed(n_words);
+    for (int y = 0; y < this->_size_y; ++y) {
+        uint64_t *row = this->row(y);
+
+        for (size_t i = 0; i < n_words; ++i) {
+            reversed[i] = reverse_bits(row[n_words - 1 - i]);
+        }
+
+        for (size_t i = 0; i < folded_words; ++i) {
+            uint64_t mirrored = 0;
+            if (shift >= 0) {
+                size_t i_src = i + word_shift;
+                if (i_src < n_words) mirrored |= reversed[i_src] >> bit_shift;
+                if (bit_shift != 0 && i_src + 1 < n_words) mirrored |= reversed[i_src + 1] << (64 - bit_shift);
+            }
+            else {
+                if (i >= word_shift) mirrored |= reversed[i - word_shift] << bit_shift;
+                if (bit_shift != 0 && i >= word_shift + 1) mirrored |= reversed[i - word_shift - 1] >> (64 - bit_shift);
+            }
+            row[i] |= mirrored;
+        }
+
+        if (folded_words > 0) row[folded_words - 1] &= last_word_mask;
+        for (size_t i = folded_words; i < n_words; ++i) {
+            row[i] = 0;
         }
     }
 
-    g_size_x = fold_line_coord;
+    this->_size_x = fold_line_coord;
 }
 
-void fold_up(int fold_line_coord) {
-    for (int y1 = fold_line_coord - 1, y2 = fold_line_coord + 1; y1 >= 0 && y2 < g_size_y; --y1, ++y2) {
-        for (int x = 0; x < g_size_x; ++x) {
-            g_dots[x][y1] = g_dots[x][y1] || g_dots[x][y2];
+void dot_sheet::fold_up(int fold_line_coord) {
+    if (fold_line_coord < 0) throw runtime_error("Fold line outside the sheet");
+    if (fold_line_coord >= this->_size_y) {
+        this->extend(this->_size_x, fold_line_coord);
+        return;
+    }
+
+    const size_t n_words = this->active_row_words();
+    for (int y1 = fold_line_coord - 1, y2 = fold_line_coord + 1; y1 >= 0 && y2 < this->_size_y; --y1, ++y2) {
+        uint64_t *row1 = this->row(y1);
+        const uint64_t *row2 = this->row(y2);
+        for (size_t i = 0; i < n_words; ++i) {
+            row1[i] |= row2[i];
         }
     }
 
-    g_size_y = fold_line_coord;
+    this->_size_y = fold_line_coord;
 }
 
-int count_dots() {
-    int dots = 0;
+int64_t dot_sheet::count_dots() const {
+    const size_t n_words = this->active_row_words();
 
-    for (int y = 0; y < g_size_y; ++y) {
-        for (int x = 0; x < g_size_x; ++x) {
-             if (g_dots[x][y]) ++dots;
+    int64_t dots = 0;
+    for (int y = 0; y < this->_size_y; ++y) {
+        const uint64_t *row = this->row(y);
+        for (size_t i = 0; i < n_words; ++i) {
+            dots += popcount(row[i]);
         }
     }
 
     return dots;
 }
 
-void print_dots() {
-    for (int y = 0; y < g_size_y; ++y) {
-        for (int x = 0; x < g_size_x; ++x) {
-            cout << (g_dots[x][y] ? '#' : '.');
+uint64_t *dot_sheet::row(int y) {
+    return this->words.data() + static_cast<size_t>(y) * this->row_stride;
+}
+
+const uint64_t *dot_sheet::row(int y) const {
+    return this->words.data() + static_cast<size_t>(y) * this->row_stride;
+}
+
+size_t dot_sheet::active_row_words() const {
+    return (static_cast<size_t>(this->_size_x) + 63) / 64;
+}
+
+void dot_sheet::extend(int size_x, int size_y) {
+    // folding left clears the bits past the sheet's right edge, but folding up leaves the rows past
+    // its bottom edge behind, so those are cleared before they become part of the sheet again
+    fill(this->words.begin() + static_cast<ptrdiff_t>(this->row_stride * static_cast<size_t>(this->_size_y)), this->words.end(), 0);
+
+    size_t row_stride = max(this->row_stride, (static_cast<size_t>(size_x) + 63) / 64);
+    if (row_stride != this->row_stride) {
+        vector<uint64_t> words(row_stride * static_cast<size_t>(this->_size_y), 0);
+        for (int y = 0; y < this->_size_y; ++y) {
+            copy(this->row(y), this->row(y) + this->row_stride, words.begin() + static_cast<ptrdiff_t>(static_cast<size_t>(y) * row_stride));
         }
-        cout << endl;
+        this->words = move(words);
+        this->row_stride = row_stride;
     }
+    this->words.resize(max(this->words.size(), this->row_stride * static_cast<size_t>(size_y)), 0);
+
+    this->_size_x = size_x;
+    this->_size_y = size_y;
+}
+
+void print_dots(const dot_sheet &sheet) {
+    string row(static_cast<size_t>(sheet.size_x()), '.');
+    for (int y = 0; y < sheet.size_y(); ++y) {
+        for (int x = 0; x < sheet.size_x(); ++x) {
+            row[static_cast<size_t>(x)] = sheet.at(x, y) ? '#' : '.';
+        }
+        cout << row << '\n';
+    }
+    cout << flush;
+}
+
+uint64_t reverse_bits(uint64_t word) {
+    word = ((word >> 1) & 0x5555555555555555) | ((word & 0x5555555555555555) << 1);
+    word = ((word >> 2) & 0x3333333333333333) | ((word & 0x3333333333333333) << 2);
+    word = ((word >> 4) & 0x0F0F0F0F0F0F0F0F) | ((word & 0x0F0F0F0F0F0F0F0F) << 4);
+    word = ((word >> 8) & 0x00FF00FF00FF00FF) | ((word & 0x00FF00FF00FF00FF) << 8);
+    word = ((word >> 16) & 0x0000FFFF0000FFFF) | ((word & 0x0000FFFF0000FFFF) << 16);
+
+    return (word >> 32) | (word << 32);
+}
+
+string recognize_code(const dot_sheet &sheet) {
+    // unknown glyphs are returned as '?', as are all letters of a sheet which is not one line high
+    string code;
+    for (int letter_x = 0; letter_x < sheet.size_x(); letter_x += letter_size_x + 1) {
+        if (sheet.size_y() != letter_size_y) {
+            code += '?';
+            continue;
+        }
+
+        uint32_t mask = 0;
+        for (int y = 0; y < letter_size_y; ++y) {
+            for (int x = letter_x; x < letter_x + letter_size_x; ++x) {
+                mask = mask << 1 | (x < sheet.size_x() && sheet.at(x, y) ? 1 : 0);
+            }
+        }
+
+        char letter = '?';
+        for (letter_glyph glyph : g_letter_glyphs) {
+            if (glyph.mask == mask) letter = glyph.letter;
+        }
+        code += letter;
+    }
+
+    return code;
 }
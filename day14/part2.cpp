@@ -1,65 +1,284 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <map>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <optional>
 #include "string_utils.h"
 
 using namespace std;
 
-typedef map<string, char> insertion_rules;
+// Exact counts grow by one bit per step at most, and every step touches all of their limbs.
+const uint64_t max_wide_steps = 20000;
+
+// Magnitudes keep their exponents in 64 bits, and the counts grow by at most one bit per step.
+const uint64_t max_magnitude_steps = uint64_t(1) << 62;
+
+// Elements are the letters A-Z, indexed from 0; the pair of elements a, b is indexed as a * 26 + b.
+const int n_elements = 26;
+const int n_pairs = n_elements * n_elements;
+
+typedef vector<uint64_t> pair_counts;
+
+// An insertion rule turns every src pair into the pairs dst1 and dst2.
+struct insertion_rule {
+    uint16_t src;
+    uint16_t dst1;
+    uint16_t dst2;
+};
+
+struct insertion_rules {
+    vector<insertion_rule> rules;
+    vector<uint16_t> unchanged_pairs;
+};
 
 struct polymer {
-    map<string, uint64_t> pairs;
-    map<char, uint64_t> elements;
+    pair_counts pairs;
+    int last_element;
+};
+
+// Arithmetic policies for the growth operator: a policy converts, multiplies and accumulates counts.
+struct checked_arithmetic {
+    typedef uint64_t value_type;
+    typedef uint64_t accumulator_type;
+
+    // set once any count no longer fits into 64 bits, which makes all results meaningless
+    mutable bool overflowed = false;
+
+    value_type from_count(uint64_t count) const { return count; }
+    void multiply_add(accumulator_type &acc, value_type a, value_type b) const {
+        uint64_t product;
+        bool product_overflowed = __builtin_mul_overflow(a, b, &product);
+        bool sum_overflowed = __builtin_add_overflow(acc, product, &acc);
+        this->overflowed |= product_overflowed | sum_overflowed;
+    }
+    value_type reduce(accumulator_type acc) const { return acc; }
+};
+
+struct modular_arithmetic {
+    typedef uint64_t value_type;
+    typedef unsigned __int128 accumulator_type;
+
+    // at most 2^63, so that a reduced accumulator plus one product never overflows
+    uint64_t modulus;
+
+    value_type from_count(uint64_t count) const { return count % this->modulus; }
+    void multiply_add(accumulator_type &acc, value_type a, value_type b) const {
+        acc += static_cast<accumulator_type>(a) * b;
+        if (acc >> 126) acc %= this->modulus;
+    }
+    value_type reduce(accumulator_type acc) const { return static_cast<value_type>(acc % this->modulus); }
+};
+
+// A count kept as mantissa * 2^exponent, the mantissa normalised into [0.5, 1) or 0 for no count, so
+// that its relative precision does not depend on how large the count grows.
+template<class float_type>
+struct magnitude {
+    float_type mantissa;
+    int64_t exponent;
+
+    bool operator == (const magnitude &rhs) const = default;
+    bool operator < (const magnitude &rhs) const {
+        if (this->mantissa == 0 || rhs.mantissa == 0 || this->exponent == rhs.exponent) return this->mantissa < rhs.mantissa;
+        return this->exponent < rhs.exponent;
+    }
+    bool operator > (const magnitude &rhs) const { return rhs < *this; }
+};
+
+// Keeps only the magnitudes of the counts, which is enough to tell the most and least common
+// elements apart when the counts themselves are only known modulo some number. Sums are aligned to
+// the exponent of their largest term; smaller terms that fall below the mantissa's precision are dropped.
+template<class float_type>
+struct magnitude_arithmetic {
+    typedef magnitude<float_type> value_type;
+    typedef magnitude<float_type> accumulator_type;
+
+    static constexpr int64_t max_shift = numeric_limits<float_type>::digits + 2;
+
+    value_type from_count(uint64_t count) const { return this->reduce({static_cast<float_type>(count), 0}); }
+    void multiply_add(accumulator_type &acc, value_type a, value_type b) const;
+    value_type reduce(accumulator_type acc) const;
+};
+
+// Arbitrary-precision counts, all of them stored with the same number of 32-bit limbs kept in 64-bit
+// words (least significant limb first). Adding counts limb by limb leaves the carries in the upper
+// halves of the words, so that whole limb rows are added without a carry chain; propagate_carries()
+// then normalizes the limbs and widens all counts when the largest one outgrows them.
+class wide_counts {
+public:
+    wide_counts(size_t n_counts, size_t n_limbs);
+
+    size_t n_counts() const { return this->_n_counts; }
+    size_t n_limbs() const { return this->_n_limbs; }
+    uint64_t *limbs(size_t i) { return &this->_limbs[i * this->_n_limbs]; }
+    const uint64_t *limbs(size_t i) const { return &this->_limbs[i * this->_n_limbs]; }
+
+    void clear(size_t n_limbs);
+    void add(size_t i, const wide_counts &other, size_t j);
+    void propagate_carries();
+    bool is_zero(size_t i) const;
+    int compare(size_t i, size_t j) const;
+    void subtract(size_t i, size_t j);
+    string to_string(size_t i) const;
+
+private:
+    size_t _n_counts;
+    size_t _n_limbs;
+    vector<uint64_t> _limbs;
+};
+
+// The linear map of one growth step, restricted to the pairs reachable from the template. Every pair
+// turns into at most 2 pairs, so the operator is stored as a list of targets per state; the last
+// element of the polymer never changes and gets a state of its own that maps onto itself.
+class growth_operator {
+public:
+    growth_operator(const polymer &poly, const insertion_rules &rules);
+
+    template<class arithmetic>
+    vector<typename arithmetic::value_type> element_counts_after(uint64_t n_steps, const arithmetic &arith) const;
+    wide_counts wide_element_counts_after(uint64_t n_steps) const;
+
+private:
+    vector<uint64_t> _initial_counts;
+    vector<int> _state_elements;
+    vector<vector<size_t>> _state_targets;
 };
 
 tuple<polymer, insertion_rules> parse_input(const string &filename);
-void grow_polymer(const insertion_rules &rules, polymer &poly);
+vector<uint64_t> count_elements(const polymer &poly);
+template<class value_type> tuple<int, int> find_most_and_least_common(const vector<value_type> &elements, value_type absent);
+tuple<int, int> find_most_and_least_common(const wide_counts &elements);
+template<class float_type>
+long double magnitude_ratio(const magnitude<float_type> &a, const magnitude<float_type> &b);
+optional<int> find_indistinguishable(const vector<magnitude<long double>> &magnitudes, const vector<magnitude<double>> &check_magnitudes, int element);
 void print_stats(const polymer &poly);
 
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        cout << "Usage: <exe> <filename>\n";
+        cout << "Usage: <exe> <filename> [<steps> [<modulus>]]\n";
         return 1;
     }
     const string filename = argv[1];
 
+    uint64_t n_steps = 40;
+    if (argc > 2) {
+        const string n_steps_arg = argv[2];
+
+        auto [parse_end, parse_error] = from_chars(n_steps_arg.data(), n_steps_arg.data() + n_steps_arg.size(), n_steps);
+        if (parse_error != errc() || parse_end != n_steps_arg.data() + n_steps_arg.size()) {
+            cout << "Invalid number of steps: " << n_steps_arg << endl;
+            return 1;
+        }
+    }
+
+    uint64_t modulus = 0;
+    if (argc > 3) {
+        const string modulus_arg = argv[3];
+
+        auto [parse_end, parse_error] = from_chars(modulus_arg.data(), modulus_arg.data() + modulus_arg.size(), modulus);
+        if (parse_error != errc() || parse_end != modulus_arg.data() + modulus_arg.size() || modulus == 0 || modulus > (uint64_t(1) << 63)) {
+            cout << "Invalid modulus: " << modulus_arg << endl;
+            return 1;
+        }
+    }
+
     auto [polymer, rules] = parse_input(filename);
+    growth_operator growth(polymer, rules);
+
+    if (modulus == 0) {
+        // 64-bit counts are tried first and promoted to wide counts only when they overflow
+        checked_arithmetic checked_arith;
+        vector<uint64_t> elements = growth.element_counts_after(n_steps, checked_arith);
+
+        if (!checked_arith.overflowed) {
+            auto [most_common, least_common] = find_most_and_least_common(elements, uint64_t(0));
+
+            uint64_t most_common_count = elements[static_cast<size_t>(most_common)];
+            uint64_t least_common_count = elements[static_cast<size_t>(least_common)];
+            cout << "Most common element: " << static_cast<char>('A' + most_common) << " (" << most_common_count << ")" << endl
+                 << "Least common element: " << static_cast<char>('A' + least_common) << " (" << least_common_count << ")" << endl
+                 << "Answer: " << most_common_count - least_common_count << endl;
+        }
+        else {
+            if (n_steps > max_wide_steps) {
+                cout << "Counts overflow 64 bits, exact counts are limited to " << max_wide_steps << " steps; pass a modulus for longer runs" << endl;
+                return 1;
+            }
+
+            wide_counts wide_elements = growth.wide_element_counts_after(n_steps);
+            auto [most_common, least_common] = find_most_and_least_common(wide_elements);
 
-    for (int i = 0; i < 40; ++i) {
-        grow_polymer(rules, polymer);
+            cout << "Most common element: " << static_cast<char>('A' + most_common) << " (" << wide_elements.to_string(static_cast<size_t>(most_common)) << ")" << endl
+                 << "Least common element: " << static_cast<char>('A' + least_common) << " (" << wide_elements.to_string(static_cast<size_t>(least_common)) << ")" << endl;
+            wide_elements.subtract(static_cast<size_t>(most_common), static_cast<size_t>(least_common));
+            cout << "Answer: " << wide_elements.to_string(static_cast<size_t>(most_common)) << endl;
+        }
     }
+    else {
+        if (n_steps > max_magnitude_steps) {
+            cout << "The magnitudes of the counts are limited to " << max_magnitude_steps << " steps" << endl;
+            return 1;
+        }
+
+        // The magnitudes are computed in long double and, to estimate their rounding errors, once more
+        // in double. Elements whose magnitudes are too close to tell apart make the answer ambiguous.
+        vector<uint64_t> elements = growth.element_counts_after(n_steps, modular_arithmetic{modulus});
+        vector<magnitude<long double>> magnitudes = growth.element_counts_after(n_steps, magnitude_arithmetic<long double>());
+        vector<magnitude<double>> check_magnitudes = growth.element_counts_after(n_steps, magnitude_arithmetic<double>());
+        auto [most_common, least_common] = find_most_and_least_common(magnitudes, magnitude<long double>{0, 0});
 
-    auto it_most_common = polymer.elements.cbegin();
-    auto it_least_common = polymer.elements.cbegin();
-    for (auto it = polymer.elements.cbegin(); it != polymer.elements.cend(); ++it) {
-        if (it->second > it_most_common->second) it_most_common = it;
-        if (it->second < it_least_common->second) it_least_common = it;
+        optional<int> other_most_common = find_indistinguishable(magnitudes, check_magnitudes, most_common);
+        optional<int> other_least_common = find_indistinguishable(magnitudes, check_magnitudes, least_common);
+        auto print_element = [&] (const string &title, int element, optional<int> other_element) {
+            cout << title << static_cast<char>('A' + element);
+            if (other_element) {
+                cout << " or " << static_cast<char>('A' + *other_element) << " (too close to tell apart)" << endl;
+            }
+            else {
+                cout << " (" << elements[static_cast<size_t>(element)] << " mod " << modulus << ")" << endl;
+            }
+        };
+        print_element("Most common element: ", most_common, other_most_common);
+        print_element("Least common element: ", least_common, other_least_common);
+
+        if (other_most_common || other_least_common) {
+            cout << "Answer: ambiguous" << endl;
+            return 1;
+        }
+
+        uint64_t most_common_count = elements[static_cast<size_t>(most_common)];
+        uint64_t least_common_count = elements[static_cast<size_t>(least_common)];
+        cout << "Answer: " << (most_common_count + modulus - least_common_count) % modulus << " mod " << modulus << endl;
     }
-    cout << "Most common element: " << it_most_common->first << " (" << it_most_common->second << ")" << endl
-         << "Least common element: " << it_least_common->first << " (" << it_least_common->second << ")" << endl
-         << "Answer: " << it_most_common->second - it_least_common->second << endl;
 }
 
 tuple<polymer, insertion_rules> parse_input(const string &filename) {
     ifstream input_file(filename);
-    polymer poly;
+    polymer poly = {.pairs = pair_counts(n_pairs), .last_element = -1};
     insertion_rules rules;
 
+    auto element_index = [] (char c) {
+        if (c < 'A' || c > 'Z') throw runtime_error("Invalid element");
+        return c - 'A';
+    };
+
     string polymer_template;
     getline(input_file, polymer_template);
+    if (polymer_template.empty()) throw runtime_error("Empty polymer template");
 
-    string pair;
-    for (size_t i = 0; (pair = polymer_template.substr(i, 2)).size() == 2; ++i) {
-        poly.pairs[pair] += 1;
-    }
-    for (char c : polymer_template) {
-        poly.elements[c] += 1;
+    for (size_t i = 0; i + 1 < polymer_template.size(); ++i) {
+        ++poly.pairs[static_cast<size_t>(element_index(polymer_template[i]) * n_elements + element_index(polymer_template[i + 1]))];
     }
+    poly.last_element = element_index(polymer_template.back());
 
     expect_line(input_file, "");
 
+    vector<bool> has_rule(n_pairs);
     string line;
     while (getline(input_file, line)) {
         istringstream iss(line);
@@ -67,46 +286,388 @@ tuple<polymer, insertion_rules> parse_input(const string &filename) {
         string pair;
         char inserted_element;
         iss >> pair >> expect(" -> ") >> inserted_element;
+        if (pair.size() != 2) throw runtime_error("Invalid insertion rule");
 
-        rules[pair] = inserted_element;
+        int a = element_index(pair[0]);
+        int b = element_index(pair[1]);
+        int inserted = element_index(inserted_element);
+        if (has_rule[static_cast<size_t>(a * n_elements + b)]) throw runtime_error("Duplicate insertion rule");
+
+        has_rule[static_cast<size_t>(a * n_elements + b)] = true;
+        rules.rules.push_back({
+            static_cast<uint16_t>(a * n_elements + b),
+            static_cast<uint16_t>(a * n_elements + inserted),
+            static_cast<uint16_t>(inserted * n_elements + b),
+        });
+    }
+
+    for (uint16_t pair = 0; pair < n_pairs; ++pair) {
+        if (!has_rule[pair]) rules.unchanged_pairs.push_back(pair);
     }
 
     return {poly, rules};
 }
 
-void grow_polymer(const insertion_rules &rules, polymer &poly) {
-    map<string, uint64_t> new_pairs;
-    map<string, uint64_t> disappeared_pairs;
-    for (const auto &[pair, count] : poly.pairs) {
-        auto it_rule = rules.find(pair);
-        if (it_rule != rules.end()) {
-            new_pairs[string({pair[0], it_rule->second})] += count;
-            new_pairs[string({it_rule->second, pair[1]})] += count;
-            disappeared_pairs[pair] += count;
-            poly.elements[it_rule->second] += count;
-        }
+vector<uint64_t> count_elements(const polymer &poly) {
+    // every element but the polymer's last one starts exactly one pair
+    vector<uint64_t> elements(n_elements);
+    for (size_t pair = 0; pair < n_pairs; ++pair) {
+        elements[pair / n_elements] += poly.pairs[pair];
+    }
+    ++elements[static_cast<size_t>(poly.last_element)];
+
+    return elements;
+}
+
+template<class value_type>
+tuple<int, int> find_most_and_least_common(const vector<value_type> &elements, value_type absent) {
+    int most_common = -1;
+    int least_common = -1;
+    for (int element = 0; element < n_elements; ++element) {
+        value_type count = elements[static_cast<size_t>(element)];
+        if (count == absent) continue;
+
+        if (most_common < 0 || count > elements[static_cast<size_t>(most_common)]) most_common = element;
+        if (least_common < 0 || count < elements[static_cast<size_t>(least_common)]) least_common = element;
     }
+    if (most_common < 0) throw runtime_error("Empty polymer");
+
+    return {most_common, least_common};
+}
+
+tuple<int, int> find_most_and_least_common(const wide_counts &elements) {
+    int most_common = -1;
+    int least_common = -1;
+    for (int element = 0; element < n_elements; ++element) {
+        size_t i = static_cast<size_t>(element);
+        if (elements.is_zero(i)) continue;
 
-    for (const auto &[new_pair, count] : new_pairs) {
-        poly.pairs[new_pair] += count;
+        if (most_common < 0 || elements.compare(i, static_cast<size_t>(most_common)) > 0) most_common = element;
+        if (least_common < 0 || elements.compare(i, static_cast<size_t>(least_common)) < 0) least_common = element;
     }
-    for (const auto &[disappeared_pair, count] : disappeared_pairs) {
-        poly.pairs[disappeared_pair] -= count;
+    if (most_common < 0) throw runtime_error("Empty polymer");
+
+    return {most_common, least_common};
+}
+
+template<class float_type>
+long double magnitude_ratio(const magnitude<float_type> &a, const magnitude<float_type> &b) {
+    // callers skip elements more than 2^64 apart, the clamp only keeps the check magnitudes in range
+    int64_t exponent = clamp<int64_t>(a.exponent - b.exponent, -64, 64);
+    return ldexp(static_cast<long double>(a.mantissa) / b.mantissa, static_cast<int>(exponent));
+}
+
+optional<int> find_indistinguishable(const vector<magnitude<long double>> &magnitudes, const vector<magnitude<double>> &check_magnitudes, int element) {
+    // Another present element whose magnitude may be the same as element's. The rounding error of
+    // their ratio is estimated by how far the ratio computed in double is from the long double one.
+    const size_t i = static_cast<size_t>(element);
+    for (size_t other = 0; other < n_elements; ++other) {
+        if (other == i || magnitudes[other].mantissa == 0) continue;
+        if (abs(magnitudes[other].exponent - magnitudes[i].exponent) > 64) continue;
+
+        long double ratio = magnitude_ratio(magnitudes[other], magnitudes[i]);
+        long double check_ratio = magnitude_ratio(check_magnitudes[other], check_magnitudes[i]);
+        long double error = abs(check_ratio / ratio - 1) + numeric_limits<double>::epsilon();
+        if (abs(ratio - 1) <= 4 * error) return static_cast<int>(other);
     }
+
+    return nullopt;
 }
 
 void print_stats(const polymer &poly) {
     cout << "Pairs:" << endl;
-    for (const auto &[pair, count] : poly.pairs) {
-        cout << "  " << pair << ": " << count << endl;
+    for (size_t pair = 0; pair < n_pairs; ++pair) {
+        if (poly.pairs[pair] == 0) continue;
+
+        cout << "  " << static_cast<char>('A' + pair / n_elements) << static_cast<char>('A' + pair % n_elements)
+             << ": " << poly.pairs[pair] << endl;
     }
 
     uint64_t total = 0;
+    vector<uint64_t> elements = count_elements(poly);
     cout << endl
          << "Elements:" << endl;
-    for (const auto &[element, count] : poly.elements) {
-        cout << "  " << element << ": " << count << endl;
-        total += count;
+    for (size_t element = 0; element < n_elements; ++element) {
+        if (elements[element] == 0) continue;
+
+        cout << "  " << static_cast<char>('A' + element) << ": " << elements[element] << endl;
+        total += elements[element];
     }
     cout << "  Total: " << total << endl;
 }
+
+template<class float_type>
+void magnitude_arithmetic<float_type>::multiply_add(accumulator_type &acc, value_type a, value_type b) const {
+    if (a.mantissa == 0 || b.mantissa == 0) return;
+
+    float_type mantissa = a.mantissa * b.mantissa;
+    int64_t exponent = a.exponent + b.exponent;
+    if (acc.mantissa == 0) {
+        acc = {mantissa, exponent};
+        return;
+    }
+
+    int64_t shift = exponent - acc.exponent;
+    if (shift > 0) {
+        acc.mantissa = shift > max_shift ? 0 : ldexp(acc.mantissa, static_cast<int>(-shift));
+        acc.mantissa += mantissa;
+        acc.exponent = exponent;
+    }
+    else if (shift >= -max_shift) {
+        acc.mantissa += ldexp(mantissa, static_cast<int>(shift));
+    }
+}
+
+template<class float_type>
+typename magnitude_arithmetic<float_type>::value_type magnitude_arithmetic<float_type>::reduce(accumulator_type acc) const {
+    if (acc.mantissa == 0) return {0, 0};
+
+    int exponent;
+    float_type mantissa = frexp(acc.mantissa, &exponent);
+
+    return {mantissa, acc.exponent + exponent};
+}
+
+wide_counts::wide_counts(size_t n_counts, size_t n_limbs) :
+    _n_counts(n_counts),
+    _n_limbs(n_limbs),
+    _limbs(n_counts * n_limbs) {
+}
+
+void wide_counts::clear(size_t n_limbs) {
+    this->_n_limbs = n_limbs;
+    this->_limbs.assign(this->_n_counts * n_limbs, 0);
+}
+
+void wide_counts::add(size_t i, const wide_counts &other, size_t j) {
+    // the limbs of other must be normalized and this must have at least as many
+    uint64_t *row = this->limbs(i);
+    const uint64_t *other_row = other.limbs(j);
+    for (size_t l = 0; l < other.n_limbs(); ++l) {
+        row[l] += other_row[l];
+    }
+}
+
+void wide_counts::propagate_carries() {
+    vector<uint64_t> top_carries(this->_n_counts);
+    bool widen = false;
+    for (size_t i = 0; i < this->_n_counts; ++i) {
+        uint64_t *row = this->limbs(i);
+        uint64_t carry = 0;
+        for (size_t l = 0; l < this->_n_limbs; ++l) {
+            uint64_t limb = row[l] + carry;
+            row[l] = limb & 0xffffffff;
+            carry = limb >> 32;
+        }
+        top_carries[i] = carry;
+        widen |= carry != 0;
+    }
+    if (!widen) return;
+
+    // a carry out of the top limb fits into one more limb, as no word overflowed before
+    const size_t n_limbs = this->_n_limbs + 1;
+    vector<uint64_t> limbs(this->_n_counts * n_limbs);
+    for (size_t i = 0; i < this->_n_counts; ++i) {
+        copy(this->limbs(i), this->limbs(i) + this->_n_limbs, &limbs[i * n_limbs]);
+        limbs[i * n_limbs + this->_n_limbs] = top_carries[i];
+    }
+    this->_n_limbs = n_limbs;
+    this->_limbs = move(limbs);
+}
+
+bool wide_counts::is_zero(size_t i) const {
+    const uint64_t *row = this->limbs(i);
+    return all_of(row, row + this->_n_limbs, [] (uint64_t limb) { return limb == 0; });
+}
+
+int wide_counts::compare(size_t i, size_t j) const {
+    const uint64_t *row = this->limbs(i);
+    const uint64_t *other_row = this->limbs(j);
+    for (size_t l = this->_n_limbs; l-- > 0; ) {
+        if (row[l] != other_row[l]) return row[l] < other_row[l] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+void wide_counts::subtract(size_t i, size_t j) {
+    // count i must not be smaller than count j
+    uint64_t *row = this->limbs(i);
+    const uint64_t *other_row = this->limbs(j);
+    uint64_t borrow = 0;
+    for (size_t l = 0; l < this->_n_limbs; ++l) {
+        uint64_t limb = row[l] - other_row[l] - borrow;
+        row[l] = limb & 0xffffffff;
+        borrow = limb >> 63;
+    }
+}
+
+string wide_counts::to_string(size_t i) const {
+    // split off 9 decimal digits at a time by long division of the limbs
+    vector<uint64_t> quotient(this->limbs(i), this->limbs(i) + this->_n_limbs);
+    vector<uint32_t> digit_groups;
+    while (any_of(quotient.cbegin(), quotient.cend(), [] (uint64_t limb) { return limb != 0; })) {
+        uint64_t remainder = 0;
+        for (size_t l = quotient.size(); l-- > 0; ) {
+            uint64_t dividend = (remainder << 32) | quotient[l];
+            quotient[l] = dividend / 1000000000;
+            remainder = dividend % 1000000000;
+        }
+        digit_groups.push_back(static_cast<uint32_t>(remainder));
+    }
+    if (digit_groups.empty()) return "0";
+
+    string result = std::to_string(digit_groups.back());
+    for (size_t g = digit_groups.size() - 1; g-- > 0; ) {
+        string digits = std::to_string(digit_groups[g]);
+        result += string(9 - digits.size(), '0') + digits;
+    }
+
+    return result;
+}
+
+growth_operator::growth_operator(const polymer &poly, const insertion_rules &rules) {
+    vector<uint16_t> pair_targets[n_pairs];
+    for (insertion_rule rule : rules.rules) {
+        pair_targets[rule.src] = {rule.dst1, rule.dst2};
+    }
+    for (uint16_t pair : rules.unchanged_pairs) {
+        pair_targets[pair] = {pair};
+    }
+
+    // number the pairs reachable from the template in the order they are found
+    vector<int> pair_states(n_pairs, -1);
+    vector<uint16_t> state_pairs;
+    for (uint16_t pair = 0; pair < n_pairs; ++pair) {
+        if (poly.pairs[pair] == 0) continue;
+
+        pair_states[pair] = static_cast<int>(state_pairs.size());
+        state_pairs.push_back(pair);
+    }
+    for (size_t i_state = 0; i_state < state_pairs.size(); ++i_state) {
+        for (uint16_t target : pair_targets[state_pairs[i_state]]) {
+            if (pair_states[target] >= 0) continue;
+
+            pair_states[target] = static_cast<int>(state_pairs.size());
+            state_pairs.push_back(target);
+        }
+    }
+
+    for (uint16_t pair : state_pairs) {
+        this->_initial_counts.push_back(poly.pairs[pair]);
+        this->_state_elements.push_back(pair / n_elements);
+
+        vector<size_t> &targets = this->_state_targets.emplace_back();
+        for (uint16_t target : pair_targets[pair]) {
+            targets.push_back(static_cast<size_t>(pair_states[target]));
+        }
+    }
+
+    this->_initial_counts.push_back(1);
+    this->_state_elements.push_back(poly.last_element);
+    this->_state_targets.push_back({state_pairs.size()});
+}
+
+template<class arithmetic>
+vector<typename arithmetic::value_type> growth_operator::element_counts_after(uint64_t n_steps, const arithmetic &arith) const {
+    typedef typename arithmetic::value_type value_type;
+    typedef typename arithmetic::accumulator_type accumulator_type;
+    const size_t n_states = this->_state_elements.size();
+
+    // power holds the operator raised to successive powers of two as a dense matrix, where
+    // power[i * n_states + j] is how many of state i a single state j turns into
+    vector<value_type> power(n_states * n_states);
+    for (size_t j = 0; j < n_states; ++j) {
+        vector<uint64_t> target_counts(n_states);
+        for (size_t target : this->_state_targets[j]) {
+            ++target_counts[target];
+        }
+        for (size_t i = 0; i < n_states; ++i) {
+            power[i * n_states + j] = arith.from_count(target_counts[i]);
+        }
+    }
+
+    vector<value_type> counts(n_states);
+    for (size_t i = 0; i < n_states; ++i) {
+        counts[i] = arith.from_count(this->_initial_counts[i]);
+    }
+
+    const value_type zero = arith.from_count(0);
+    vector<accumulator_type> acc(n_states);
+    vector<value_type> product(n_states * n_states);
+    for (uint64_t remaining_steps = n_steps; remaining_steps > 0; remaining_steps >>= 1) {
+        if (remaining_steps & 1) {
+            fill(acc.begin(), acc.end(), accumulator_type());
+            for (size_t i = 0; i < n_states; ++i) {
+                for (size_t k = 0; k < n_states; ++k) {
+                    arith.multiply_add(acc[i], power[i * n_states + k], counts[k]);
+                }
+            }
+            for (size_t i = 0; i < n_states; ++i) {
+                counts[i] = arith.reduce(acc[i]);
+            }
+        }
+
+        if (remaining_steps > 1) {
+            for (size_t i = 0; i < n_states; ++i) {
+                fill(acc.begin(), acc.end(), accumulator_type());
+                for (size_t k = 0; k < n_states; ++k) {
+                    value_type factor = power[i * n_states + k];
+                    if (factor == zero) continue;
+
+                    const value_type *power_row = &power[k * n_states];
+                    for (size_t j = 0; j < n_states; ++j) {
+                        arith.multiply_add(acc[j], factor, power_row[j]);
+                    }
+                }
+                for (size_t j = 0; j < n_states; ++j) {
+                    product[i * n_states + j] = arith.reduce(acc[j]);
+                }
+            }
+            swap(power, product);
+        }
+    }
+
+    vector<accumulator_type> element_acc(n_elements);
+    for (size_t i = 0; i < n_states; ++i) {
+        arith.multiply_add(element_acc[static_cast<size_t>(this->_state_elements[i])], counts[i], arith.from_count(1));
+    }
+
+    vector<value_type> elements(n_elements);
+    for (size_t element = 0; element < n_elements; ++element) {
+        elements[element] = arith.reduce(element_acc[element]);
+    }
+
+    return elements;
+}
+
+wide_counts growth_operator::wide_element_counts_after(uint64_t n_steps) const {
+    const size_t n_states = this->_state_elements.size();
+
+    wide_counts counts(n_states, 2);
+    for (size_t i = 0; i < n_states; ++i) {
+        counts.limbs(i)[0] = this->_initial_counts[i];
+    }
+    counts.propagate_carries();
+
+    // step by step, as a step only adds counts while a power of the operator would multiply them
+    wide_counts grown_counts(n_states, 1);
+    for (uint64_t step = 0; step < n_steps; ++step) {
+        grown_counts.clear(counts.n_limbs());
+        for (size_t j = 0; j < n_states; ++j) {
+            for (size_t target : this->_state_targets[j]) {
+                grown_counts.add(target, counts, j);
+            }
+        }
+        grown_counts.propagate_carries();
+        swap(counts, grown_counts);
+    }
+
+    wide_counts elements(n_elements, counts.n_limbs());
+    for (size_t i = 0; i < n_states; ++i) {
+        elements.add(static_cast<size_t>(this->_state_elements[i]), counts, i);
+    }
+    elements.propagate_carries();
+
+    return elements;
+}
@@ -1,7 +1,10 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 #include <queue>
+#include <limits>
+#include <algorithm>
 #include <functional>
 
 using namespace std;
@@ -20,6 +23,7 @@ public:
 
     int size_x() const;
     int size_y() const;
+    int max_weight() const;
 
     void each_neighbour(vertex v, const function<void(vertex, int)> &block) const;
 
@@ -29,7 +33,44 @@ private:
     int map_size_y;
 };
 
-int shortest_path(const graph &g, graph::vertex start, graph::vertex end);
+struct queued_vertex {
+    int distance;
+    graph::vertex v;
+
+    bool operator > (const queued_vertex &rhs) const { return this->distance > rhs.distance; }
+};
+
+// Dial's algorithm: with edge weights of at most max_weight, every queued distance is within
+// max_weight of the smallest one, so a ring of max_weight + 1 buckets indexed by distance serves
+// as the priority queue.
+class bucket_queue {
+public:
+    explicit bucket_queue(int max_weight);
+
+    bool empty() const;
+    void push(queued_vertex qv);
+    queued_vertex pop();
+
+private:
+    vector<vector<graph::vertex>> _buckets;
+    int _min_distance;
+    size_t _size;
+};
+
+// Binary heap fallback for weights too large to give every distance its own bucket.
+class heap_queue {
+public:
+    bool empty() const;
+    void push(queued_vertex qv);
+    queued_vertex pop();
+
+private:
+    priority_queue<queued_vertex, vector<queued_vertex>, greater<queued_vertex>> _heap;
+};
+
+const int max_bucket_weight = 64;
+
+template<class vertex_queue> int shortest_path(const graph &g, graph::vertex start, graph::vertex end, vertex_queue queue);
 
 
 int main(int argc, char *argv[]) {
@@ -45,7 +86,12 @@ int main(int argc, char *argv[]) {
     g.expand_map();
     cout << "Expanded size: " << g.size_x() << " " << g.size_y() << endl;
 
-    cout << "Minimal risk path: " << shortest_path(g, graph::vertex({0, 0}), graph::vertex({g.size_x() - 1, g.size_y() - 1})) << endl;
+    graph::vertex start = {0, 0};
+    graph::vertex end = {g.size_x() - 1, g.size_y() - 1};
+    int risk = g.max_weight() <= max_bucket_weight
+        ? shortest_path(g, start, end, bucket_queue(g.max_weight()))
+        : shortest_path(g, start, end, heap_queue());
+    cout << "Minimal risk path: " << risk << endl;
 }
 
 graph::graph(istream &input) {
@@ -106,6 +152,15 @@ int graph::size_y() const {
     return this->map_size_y;
 }
 
+int graph::max_weight() const {
+    uint8_t max_weight = 0;
+    for (int y = 0; y < this->map_size_y; ++y) {
+        max_weight = max(max_weight, *max_element(this->map[y], this->map[y] + this->map_size_x));
+    }
+
+    return max_weight;
+}
+
 void graph::each_neighbour(vertex v, const function<void(vertex, int)> &block) const {
     if (v.x - 1 >= 0) {
         block({v.x - 1, v.y}, this->map[v.y][v.x - 1]);
@@ -121,7 +176,53 @@ void graph::each_neighbour(vertex v, const function<void(vertex, int)> &block) c
     }
 }
 
-int shortest_path(const graph &g, graph::vertex start, graph::vertex end) {
+bucket_queue::bucket_queue(int max_weight) :
+    _buckets(static_cast<size_t>(max_weight + 1)),
+    _min_distance(0),
+    _size(0) {
+}
+
+bool bucket_queue::empty() const {
+    return this->_size == 0;
+}
+
+void bucket_queue::push(queued_vertex qv) {
+    this->_buckets[static_cast<size_t>(qv.distance) % this->_buckets.size()].push_back(qv.v);
+    ++this->_size;
+}
+
+queued_vertex bucket_queue::pop() {
+    // distances only grow, so the ring is scanned forward from the last popped distance
+    vector<graph::vertex> *bucket = &this->_buckets[static_cast<size_t>(this->_min_distance) % this->_buckets.size()];
+    while (bucket->empty()) {
+        ++this->_min_distance;
+        bucket = &this->_buckets[static_cast<size_t>(this->_min_distance) % this->_buckets.size()];
+    }
+
+    graph::vertex v = bucket->back();
+    bucket->pop_back();
+    --this->_size;
+
+    return {this->_min_distance, v};
+}
+
+bool heap_queue::empty() const {
+    return this->_heap.empty();
+}
+
+void heap_queue::push(queued_vertex qv) {
+    this->_heap.push(qv);
+}
+
+queued_vertex heap_queue::pop() {
+    queued_vertex qv = this->_heap.top();
+    this->_heap.pop();
+
+    return qv;
+}
+
+template<class vertex_queue>
+int shortest_path(const graph &g, graph::vertex start, graph::vertex end, vertex_queue queue) {
     struct vertex_info {
         int best_path;
         bool visited;
@@ -133,35 +234,25 @@ int shortest_path(const graph &g, graph::vertex start, graph::vertex end) {
     auto info_for = [&] (graph::vertex v) -> vertex_info & {
         return vertices_info[static_cast<size_t>(v.x * g.size_y() + v.y)];
     };
-    auto find_best_remaining_vertex = [&] () -> graph::vertex {
-        int best_path_so_far = numeric_limits<int>::max();
-        graph::vertex best_vertex_so_far;
-        for (int x = 0; x < g.size_x(); ++x) {
-            for (int y = 0; y < g.size_y(); ++y) {
-                graph::vertex v = {x, y};
-
-                if (!info_for(v).visited && info_for(v).best_path < best_path_so_far) {
-                    best_path_so_far = info_for(v).best_path;
-                    best_vertex_so_far = v;
-                }
-            }
-        }
-
-        return best_vertex_so_far;
-    };
 
     info_for(start).best_path = 0;
-    graph::vertex curr_v = start;
-    while (curr_v != end) {
+    queue.push({0, start});
+    while (!queue.empty()) {
+        queued_vertex curr = queue.pop();
+        int distance = curr.distance;
+        graph::vertex curr_v = curr.v;
+        // a vertex is queued again whenever its path improves, the outdated entries are skipped
+        if (info_for(curr_v).visited) continue;
+        if (curr_v == end) return distance;
+
         info_for(curr_v).visited = true;
-        g.each_neighbour(curr_v, [&](graph::vertex neighbour, int distance) {
-            if (info_for(neighbour).best_path > info_for(curr_v).best_path + distance) {
-                info_for(neighbour).best_path = info_for(curr_v).best_path + distance;
+        g.each_neighbour(curr_v, [&](graph::vertex neighbour, int weight) {
+            if (info_for(neighbour).best_path > distance + weight) {
+                info_for(neighbour).best_path = distance + weight;
+                queue.push({distance + weight, neighbour});
             }
         });
-
-        curr_v = find_best_remaining_vertex();
     }
 
-    return info_for(end).best_path;
+    throw runtime_error("No path to the end vertex");
 }
@@ -2,59 +2,92 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <charconv>
 #include "string_utils.h"
 
 using namespace std;
 
-const int n_ages = 9;
-uint64_t g_population[n_ages];
+class lanternfish_sim {
+public:
+    lanternfish_sim(int cycle_length = 7, int newborn_delay = 2);
 
-void parse_input(const string &filename);
-void simulate_population(int n_days);
-uint64_t calculate_population();
+    void add_fish(int timer);
+    void simulate(int n_days);
+    uint64_t population() const;
+
+private:
+    // timers[(i_zero + t) % timers.size()] holds the number of fish whose timer is t; a simulated
+    // day only moves i_zero forward instead of shifting every bucket down by one
+    vector<uint64_t> timers;
+    size_t i_zero;
+    int cycle_length;
+};
+
+lanternfish_sim parse_input(const string &filename);
 
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
+    if (argc < 3) {
         cout << "Usage: <exe> <filename> <simulated days>\n";
         return 1;
     }
     const string filename = argv[1];
-    const int simulated_days = atoi(argv[2]);
+    const string simulated_days_arg = argv[2];
 
-    parse_input(filename);
+    int simulated_days;
+    auto [parse_end, parse_error] = from_chars(simulated_days_arg.data(), simulated_days_arg.data() + simulated_days_arg.size(), simulated_days);
+    if (parse_error != errc() || parse_end != simulated_days_arg.data() + simulated_days_arg.size() || simulated_days < 0) {
+        cout << "Invalid number of simulated days: " << simulated_days_arg << endl;
+        return 1;
+    }
 
-    simulate_population(simulated_days);
+    lanternfish_sim sim = parse_input(filename);
+    sim.simulate(simulated_days);
 
-    cout << "Simulated population (" << simulated_days << "): " << calculate_population() << endl;
+    cout << "Simulated population (" << simulated_days << "): " << sim.population() << endl;
 }
 
-void parse_input(const string &filename) {
+lanternfish_sim parse_input(const string &filename) {
     ifstream input_file(filename);
+    lanternfish_sim sim;
 
     int age;
     while (input_file >> skip(",") >> age) {
-        if (age < 0 || age >= n_ages) throw runtime_error("Invalid age");
-
-        ++g_population[age];
+        sim.add_fish(age);
     }
+
+    return sim;
 }
 
-void simulate_population(int n_days) {
+lanternfish_sim::lanternfish_sim(int cycle_length, int newborn_delay) {
+    if (cycle_length < 1 || newborn_delay < 0) throw runtime_error("Invalid lanternfish cycle");
+
+    this->timers.assign(static_cast<size_t>(cycle_length + newborn_delay), 0);
+    this->i_zero = 0;
+    this->cycle_length = cycle_length;
+}
+
+void lanternfish_sim::add_fish(int timer) {
+    if (timer < 0 || static_cast<size_t>(timer) >= this->timers.size()) throw runtime_error("Invalid age");
+
+    ++this->timers[(this->i_zero + static_cast<size_t>(timer)) % this->timers.size()];
+}
+
+void lanternfish_sim::simulate(int n_days) {
+    const size_t n_timers = this->timers.size();
+
     for (int day = 0; day < n_days; ++day) {
-        uint64_t n_spawning = g_population[0];
-        for (int i_age = 1; i_age < n_ages; ++i_age) {
-            g_population[i_age - 1] = g_population[i_age];
-        }
-        g_population[6] += n_spawning;
-        g_population[8] = n_spawning;
+        // the spawning bucket becomes the newborns' bucket (highest timer) by advancing i_zero
+        uint64_t n_spawning = this->timers[this->i_zero];
+        this->i_zero = (this->i_zero + 1) % n_timers;
+        this->timers[(this->i_zero + static_cast<size_t>(this->cycle_length) - 1) % n_timers] += n_spawning;
     }
 }
 
-uint64_t calculate_population() {
+uint64_t lanternfish_sim::population() const {
     uint64_t population = 0;
-    for (int i_age = 0; i_age < n_ages; ++i_age) {
-        population += g_population[i_age];
+    for (uint64_t n_fish : this->timers) {
+        population += n_fish;
     }
 
     return population;
@@ -3,13 +3,13 @@
 #include <string>
 #include <vector>
 #include <algorithm>
-#include <limits>
+#include <tuple>
 #include "string_utils.h"
 
 using namespace std;
 
 vector<int> parse_input(const string &filename);
-tuple<int, int> find_optimum(const vector<int> &positions);
+tuple<int, int64_t> find_optimum(const vector<int> &positions);
 
 
 int main(int argc, char *argv[]) {
@@ -37,23 +37,18 @@ vector<int> parse_input(const string &filename) {
     return positions;
 }
 
-tuple<int, int> find_optimum(const vector<int> &positions) {
-    auto minmax_pair = minmax_element(positions.cbegin(), positions.cend());
-    int min_pos = *minmax_pair.first;
-    int max_pos = *minmax_pair.second;
-
-    int optimal_pos = -1;
-    int optimal_fuel = numeric_limits<int>::max();
-    for (int evaluated_pos = min_pos; evaluated_pos <= max_pos; ++evaluated_pos) {
-        int total_fuel = 0;
-        for (int pos : positions) {
-            total_fuel += abs(pos - evaluated_pos);
-        }
-
-        if (total_fuel < optimal_fuel) {
-            optimal_fuel = total_fuel;
-            optimal_pos = evaluated_pos;
-        }
+tuple<int, int64_t> find_optimum(const vector<int> &positions) {
+    if (positions.empty()) throw runtime_error("No crab positions");
+
+    // with linear fuel cost the total is minimised at the median position
+    vector<int> sorted_positions = positions;
+    auto median_it = sorted_positions.begin() + static_cast<ptrdiff_t>(sorted_positions.size() / 2);
+    nth_element(sorted_positions.begin(), median_it, sorted_positions.end());
+    int optimal_pos = *median_it;
+
+    int64_t optimal_fuel = 0;
+    for (int pos : positions) {
+        optimal_fuel += abs(static_cast<int64_t>(pos) - optimal_pos);
     }
 
     return {optimal_pos, optimal_fuel};
@@ -4,25 +4,115 @@
 #include <vector>
 #include <algorithm>
 #include <limits>
+#include <tuple>
+#include <cmath>
 #include "string_utils.h"
 
 using namespace std;
 
+// Fuel cost policies: a policy prices a single crab move of `dist` steps and declares whether the
+// resulting total fuel is convex in the target position. Policies may also narrow the search down
+// to a closed-form candidate range via optimum_candidates().
+struct linear_cost {
+    static constexpr bool convex = true;
+
+    int64_t operator () (int64_t dist) const { return dist; }
+    tuple<int, int> optimum_candidates(const vector<int> &positions) const;
+};
+
+struct triangular_cost {
+    static constexpr bool convex = true;
+
+    int64_t operator () (int64_t dist) const { return (dist * (dist + 1)) / 2; }
+    tuple<int, int> optimum_candidates(const vector<int> &positions) const;
+};
+
+struct quadratic_cost {
+    static constexpr bool convex = true;
+
+    int64_t operator () (int64_t dist) const { return dist * dist; }
+};
+
+struct table_cost {
+    static constexpr bool convex = false;
+
+    vector<int64_t> fuel_for_distance;
+
+    int64_t operator () (int64_t dist) const { return this->fuel_for_distance.at(static_cast<size_t>(dist)); }
+};
+
+struct fuel_curve_point {
+    int position;
+    int64_t linear_fuel;
+    int64_t triangular_fuel;
+};
+
 vector<int> parse_input(const string &filename);
-tuple<int, int> find_optimum(const vector<int> &positions);
+table_cost load_fuel_table(const string &filename);
+template<class cost_policy> tuple<int, int64_t> find_optimum(const vector<int> &positions, const cost_policy &cost);
+template<class cost_policy> int64_t total_fuel_at(const vector<int> &positions, int evaluated_pos, const cost_policy &cost);
+vector<fuel_curve_point> compute_fuel_curve(const vector<int> &positions);
+void export_fuel_curve(const vector<fuel_curve_point> &curve, const string &filename);
 
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        cout << "Usage: <exe> <filename>\n";
+        cout << "Usage: <exe> <filename> [--cost=linear|triangular|quadratic] [--cost-table=<fuel table filename>] [<fuel curve output filename>]\n";
         return 1;
     }
     const string filename = argv[1];
 
+    string cost_name = "triangular";
+    string table_filename;
+    string curve_filename;
+    for (int i = 2; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg.starts_with("--cost=")) {
+            cost_name = arg.substr(7);
+        }
+        else if (arg.starts_with("--cost-table=")) {
+            cost_name = "table";
+            table_filename = arg.substr(13);
+        }
+        else {
+            curve_filename = arg;
+        }
+    }
+
     vector<int> positions = parse_input(filename);
 
-    auto [optimal_position, spent_fuel] = find_optimum(positions);
+    int optimal_position;
+    int64_t spent_fuel;
+    if (cost_name == "linear") {
+        tie(optimal_position, spent_fuel) = find_optimum(positions, linear_cost());
+    }
+    else if (cost_name == "triangular") {
+        tie(optimal_position, spent_fuel) = find_optimum(positions, triangular_cost());
+    }
+    else if (cost_name == "quadratic") {
+        tie(optimal_position, spent_fuel) = find_optimum(positions, quadratic_cost());
+    }
+    else if (cost_name == "table") {
+        table_cost cost = load_fuel_table(table_filename);
+
+        auto minmax_pair = minmax_element(positions.cbegin(), positions.cend());
+        if (minmax_pair.first != positions.cend() && cost.fuel_for_distance.size() <= static_cast<size_t>(*minmax_pair.second - *minmax_pair.first)) {
+            cout << "Fuel table needs an entry for every distance up to " << *minmax_pair.second - *minmax_pair.first << endl;
+            return 1;
+        }
+
+        tie(optimal_position, spent_fuel) = find_optimum(positions, cost);
+    }
+    else {
+        cout << "Unknown fuel cost: " << cost_name << endl;
+        return 1;
+    }
     cout << "Optimal position: " << optimal_position << ", fuel: " << spent_fuel << endl;
+
+    if (!curve_filename.empty()) {
+        export_fuel_curve(compute_fuel_curve(positions), curve_filename);
+        cout << "Fuel curve written to " << curve_filename << endl;
+    }
 }
 
 vector<int> parse_input(const string &filename) {
@@ -37,21 +127,52 @@ vector<int> parse_input(const string &filename) {
     return positions;
 }
 
-tuple<int, int> find_optimum(const vector<int> &positions) {
-    auto minmax_pair = minmax_element(positions.cbegin(), positions.cend());
-    int min_pos = *minmax_pair.first;
-    int max_pos = *minmax_pair.second;
+table_cost load_fuel_table(const string &filename) {
+    // the fuel for moving 0, 1, 2, ... steps, separated by commas
+    ifstream input_file(filename);
+    if (!input_file) throw runtime_error("Cannot open fuel table " + filename);
 
-    auto fuel_for_distance = [] (int dist) { return (dist * (dist + 1)) / 2; };
+    table_cost cost;
+    int64_t fuel;
+    while (input_file >> skip(",") >> fuel) {
+        cost.fuel_for_distance.push_back(fuel);
+    }
 
-    int optimal_pos = -1;
-    int optimal_fuel = numeric_limits<int>::max();
-    for (int evaluated_pos = min_pos; evaluated_pos <= max_pos; ++evaluated_pos) {
-        int total_fuel = 0;
-        for (int pos : positions) {
-            total_fuel += fuel_for_distance(abs(pos - evaluated_pos));
+    return cost;
+}
+
+template<class cost_policy>
+tuple<int, int64_t> find_optimum(const vector<int> &positions, const cost_policy &cost) {
+    if (positions.empty()) throw runtime_error("No crab positions");
+
+    int first_candidate, last_candidate;
+    if constexpr (requires { cost.optimum_candidates(positions); }) {
+        tie(first_candidate, last_candidate) = cost.optimum_candidates(positions);
+    }
+    else {
+        auto minmax_pair = minmax_element(positions.cbegin(), positions.cend());
+        first_candidate = *minmax_pair.first;
+        last_candidate = *minmax_pair.second;
+
+        if constexpr (cost_policy::convex) {
+            // the fuel differences between neighbouring positions are non-decreasing, so binary
+            // search for the first position after which the total stops going down
+            while (first_candidate < last_candidate) {
+                int mid = first_candidate + (last_candidate - first_candidate) / 2;
+                if (total_fuel_at(positions, mid, cost) <= total_fuel_at(positions, mid + 1, cost)) {
+                    last_candidate = mid;
+                }
+                else {
+                    first_candidate = mid + 1;
+                }
+            }
         }
+    }
 
+    int optimal_pos = -1;
+    int64_t optimal_fuel = numeric_limits<int64_t>::max();
+    for (int evaluated_pos = first_candidate; evaluated_pos <= last_candidate; ++evaluated_pos) {
+        int64_t total_fuel = total_fuel_at(positions, evaluated_pos, cost);
         if (total_fuel < optimal_fuel) {
             optimal_fuel = total_fuel;
             optimal_pos = evaluated_pos;
@@ -60,3 +181,89 @@ tuple<int, int> find_optimum(const vector<int> &positions) {
 
     return {optimal_pos, optimal_fuel};
 }
+
+template<class cost_policy>
+int64_t total_fuel_at(const vector<int> &positions, int evaluated_pos, const cost_policy &cost) {
+    // branch-free loop over the packed positions so that the arithmetic policies get vectorised
+    const int *p_positions = positions.data();
+    const size_t n_positions = positions.size();
+
+    int64_t total_fuel = 0;
+    for (size_t i = 0; i < n_positions; ++i) {
+        int64_t dist = static_cast<int64_t>(p_positions[i]) - evaluated_pos;
+        total_fuel += cost(dist < 0 ? -dist : dist);
+    }
+
+    return total_fuel;
+}
+
+tuple<int, int> linear_cost::optimum_candidates(const vector<int> &positions) const {
+    // the total is minimised at the median position
+    vector<int> sorted_positions = positions;
+    auto median_it = sorted_positions.begin() + static_cast<ptrdiff_t>(sorted_positions.size() / 2);
+    nth_element(sorted_positions.begin(), median_it, sorted_positions.end());
+
+    return {*median_it, *median_it};
+}
+
+tuple<int, int> triangular_cost::optimum_candidates(const vector<int> &positions) const {
+    // the optimum lies within 0.5 of the mean position, so only the integer positions in
+    // [mean - 0.5, mean + 0.5] need to be evaluated
+    int64_t positions_sum = 0;
+    for (int pos : positions) {
+        positions_sum += pos;
+    }
+    double mean = static_cast<double>(positions_sum) / static_cast<double>(positions.size());
+
+    return {static_cast<int>(floor(mean - 0.5)), static_cast<int>(ceil(mean + 0.5))};
+}
+
+vector<fuel_curve_point> compute_fuel_curve(const vector<int> &positions) {
+    if (positions.empty()) throw runtime_error("No crab positions");
+
+    auto minmax_pair = minmax_element(positions.cbegin(), positions.cend());
+    int min_pos = *minmax_pair.first;
+    int max_pos = *minmax_pair.second;
+
+    vector<int64_t> crabs_at(static_cast<size_t>(max_pos - min_pos) + 1);
+    int64_t triangular_fuel = 0;
+    int64_t right_dist_sum = 0;
+    for (int pos : positions) {
+        int64_t dist = pos - min_pos;
+        ++crabs_at[static_cast<size_t>(dist)];
+        triangular_fuel += (dist * (dist + 1)) / 2;
+        right_dist_sum += dist;
+    }
+
+    // sweep left to right keeping the crab counts and distance sums on both sides of the
+    // evaluated position; moving one step right adds (dist + 1) fuel for every crab at or left of
+    // it and removes dist fuel for every crab right of it
+    int64_t left_count = crabs_at[0];
+    int64_t right_count = static_cast<int64_t>(positions.size()) - left_count;
+    int64_t left_dist_sum = 0;
+
+    vector<fuel_curve_point> curve;
+    curve.reserve(crabs_at.size());
+    for (size_t i = 0;; ++i) {
+        curve.push_back({min_pos + static_cast<int>(i), left_dist_sum + right_dist_sum, triangular_fuel});
+        if (i + 1 == crabs_at.size()) break;
+
+        triangular_fuel += left_dist_sum + left_count - right_dist_sum;
+        left_dist_sum += left_count;
+        right_dist_sum -= right_count;
+        left_count += crabs_at[i + 1];
+        right_count -= crabs_at[i + 1];
+    }
+
+    return curve;
+}
+
+void export_fuel_curve(const vector<fuel_curve_point> &curve, const string &filename) {
+    ofstream output_file(filename);
+    if (!output_file) throw runtime_error("Cannot open fuel curve output file");
+
+    output_file << "position,linear_fuel,triangular_fuel\n";
+    for (const fuel_curve_point &point : curve) {
+        output_file << point.position << ',' << point.linear_fuel << ',' << point.triangular_fuel << '\n';
+    }
+}
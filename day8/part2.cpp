@@ -1,155 +1,259 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <string>
 #include <vector>
+#include <bit>
+#include <array>
 #include <algorithm>
+#include <thread>
 #include "string_utils.h"
+#include "parallel_utils.h"
 
 using namespace std;
 
+// a pattern is a 7-bit mask with bit 0 standing for wire 'a', bit 1 for 'b' and so on
+typedef uint8_t segment_mask;
+
 struct display {
-    vector<string> patterns;
-    vector<string> outputs;
+    segment_mask patterns[10];
+    segment_mask outputs[4];
 };
 
-vector<display> parse_input(const string &filename);
-int decode_output(const display &display);
-string diff(const string &lhs, const string &rhs);
-string diff(const string &lhs, char rhs);
+// Every display is one of the 5040 wire-to-segment permutations. A display's signature packs, for
+// each wire, how many of the 10 patterns light it up and whether the 4-segment pattern does; the
+// counts alone leave segments a/c and d/g ambiguous, the 4-segment pattern tells them apart.
+struct wiring_entry {
+    uint32_t signature;
+    uint8_t segment_for_wire[7];
+};
 
+const int wiring_table_bits = 13;
+const size_t wiring_table_size = size_t(1) << wiring_table_bits;
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        cout << "Usage: <exe> <filename>\n";
-        return 1;
-    }
-    const string filename = argv[1];
+constexpr segment_mask segments_for_digit[10] = {
+    0b1110111, 0b0100100, 0b1011101, 0b1101101, 0b0101110, 0b1101011, 0b1111011, 0b0100101, 0b1111111, 0b1101111,
+};
 
-    vector<display> displays = parse_input(filename);
+constexpr size_t wiring_table_slot(uint32_t signature) {
+    return (signature * 2654435761u) >> (32 - wiring_table_bits);
+}
+
+constexpr array<wiring_entry, wiring_table_size> build_wiring_table() {
+    array<wiring_entry, wiring_table_size> table = {};
 
-    int outputs_sum = 0;
-    for (const display &display : displays) {
-        outputs_sum += decode_output(display);
+    uint32_t segment_counts[7] = {};
+    for (segment_mask segments : segments_for_digit) {
+        for (int segment = 0; segment < 7; ++segment) {
+            segment_counts[segment] += (segments >> segment) & 1;
+        }
     }
 
-    cout << "Output sums: " << outputs_sum << endl;
-}
+    uint8_t segment_for_wire[7] = {0, 1, 2, 3, 4, 5, 6};
+    do {
+        uint32_t signature = 0;
+        for (int wire = 0; wire < 7; ++wire) {
+            uint32_t in_four = (segments_for_digit[4] >> segment_for_wire[wire]) & 1;
+            signature |= ((segment_counts[segment_for_wire[wire]] - 4) | (in_four << 3)) << (4 * wire);
+        }
 
-vector<display> parse_input(const string &filename) {
-    ifstream input_file(filename);
-    vector<display> displays;
-
-    string line;
-    while (getline(input_file, line)) {
-        istringstream iss(line);
-        display display;
-
-        string token;
-        vector<string> *p_storage = &display.patterns;
-        while (iss >> token) {
-            if (token == "|") {
-                p_storage = &display.outputs;
-                continue;
-            }
+        size_t slot = wiring_table_slot(signature);
+        while (table[slot].signature != 0) {
+            slot = (slot + 1) % wiring_table_size;
+        }
 
-            sort(token.begin(), token.end());
-            p_storage->push_back(token);
+        table[slot].signature = signature;
+        for (int wire = 0; wire < 7; ++wire) {
+            table[slot].segment_for_wire[wire] = segment_for_wire[wire];
         }
+    }
+    while (next_permutation(segment_for_wire, segment_for_wire + 7));
 
-        sort(display.patterns.begin(), display.patterns.end(),
-             [] (const string &lhs, const string &rhs) { return lhs.size() < rhs.size(); });
+    return table;
+}
 
-        displays.push_back(display);
+constexpr array<uint8_t, 128> build_digit_table() {
+    array<uint8_t, 128> table = {};
+    for (uint8_t &digit : table) {
+        digit = 0xFF;
+    }
+    for (uint8_t digit = 0; digit < 10; ++digit) {
+        table[segments_for_digit[digit]] = digit;
     }
 
-    return displays;
+    return table;
 }
 
-int decode_output(const display &display) {
-    string digit_patterns[10];
-    char a, c, d, f, g;  // segments
+constexpr array<wiring_entry, wiring_table_size> g_wiring_table = build_wiring_table();
+constexpr array<uint8_t, 128> g_digit_for_segments = build_digit_table();
+
+// Displays are decoded in batches stored lane by lane, so that the signature computation runs
+// across all displays of a batch at once.
+const size_t batch_size = 16;
 
-    digit_patterns[1] = display.patterns[0]; // two-digit pattern
-    digit_patterns[4] = display.patterns[2]; // four-digit pattern
-    digit_patterns[7] = display.patterns[1]; // three-digit pattern
-    digit_patterns[8] = display.patterns[9]; // seven-digit pattern
+struct display_batch {
+    segment_mask patterns[10][batch_size];
+    segment_mask outputs[4][batch_size];
+    size_t n_displays;
+};
 
-    a = diff(digit_patterns[7], digit_patterns[1])[0];
+int64_t sum_outputs(istream &input, unsigned n_threads);
+int64_t sum_outputs_of_lines(const vector<string> &lines, size_t i_begin, size_t i_end);
+display parse_display(const string &line);
+int64_t decode_batch(const display_batch &batch);
+void batch_signatures(const display_batch &batch, uint32_t signatures[batch_size]);
+const wiring_entry &find_wiring(uint32_t signature);
 
-    for (size_t i = 6; i <= 8; ++i) {  // six-digit patterns
-        string curr_diff = diff(digit_patterns[1], display.patterns[i]);
-        if (!curr_diff.empty()) {
-            c = curr_diff[0];
-            digit_patterns[6] = display.patterns[i];
-            break;
-        }
-    }
-    f = diff(digit_patterns[1], c)[0];
-
-    string acf = {a, c, f};
-    for (size_t i = 3; i <= 5; ++i) {  // five-digit patterns
-        string curr_diff = diff(acf, display.patterns[i]);
-        if (curr_diff.empty()) {
-            digit_patterns[3] = display.patterns[i];
-            break;
-        }
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cout << "Usage: <exe> <filename>\n";
+        return 1;
     }
+    const string filename = argv[1];
+
+    ifstream input_file(filename);
+    unsigned n_threads = max(1u, thread::hardware_concurrency());
 
-    string dg = diff(digit_patterns[3], acf);
-    g = diff(dg, digit_patterns[4])[0];
-    d = diff(dg, g)[0];
+    cout << "Output sums: " << sum_outputs(input_file, n_threads) << endl;
+}
+
+int64_t sum_outputs(istream &input, unsigned n_threads) {
+    vector<int64_t> thread_sums(n_threads);
+
+    int64_t outputs_sum = 0;
+    process_lines_in_parallel(input, n_threads,
+        [&] (const vector<string> &lines, size_t i_begin, size_t i_end, unsigned i_thread) {
+            thread_sums[i_thread] = sum_outputs_of_lines(lines, i_begin, i_end);
+        },
+        [&] (unsigned i_thread) {
+            outputs_sum += thread_sums[i_thread];
+        });
+
+    return outputs_sum;
+}
 
-    for (size_t i = 6; i <= 8; ++i) {  // six-digit patterns
-        if (display.patterns[i] == digit_patterns[6]) {
-            continue;
+int64_t sum_outputs_of_lines(const vector<string> &lines, size_t i_begin, size_t i_end) {
+    display_batch batch = {};
+    int64_t outputs_sum = 0;
+
+    for (size_t i = i_begin; i < i_end; ++i) {
+        display display = parse_display(lines[i]);
+
+        size_t lane = batch.n_displays++;
+        for (int i_pattern = 0; i_pattern < 10; ++i_pattern) {
+            batch.patterns[i_pattern][lane] = display.patterns[i_pattern];
         }
-        else if (display.patterns[i].find(d) == string::npos) {
-            digit_patterns[0] = display.patterns[i];
+        for (int i_output = 0; i_output < 4; ++i_output) {
+            batch.outputs[i_output][lane] = display.outputs[i_output];
         }
-        else {
-            digit_patterns[9] = display.patterns[i];
+
+        if (batch.n_displays == batch_size) {
+            outputs_sum += decode_batch(batch);
+            batch.n_displays = 0;
         }
     }
+    if (batch.n_displays > 0) outputs_sum += decode_batch(batch);
 
-    for (size_t i = 3; i <= 5; ++i) {  // five-digit patterns
-        if (display.patterns[i] == digit_patterns[3]) {
-            continue;
+    return outputs_sum;
+}
+
+display parse_display(const string &line) {
+    display display;
+    segment_mask *p_storage = display.patterns;
+    segment_mask *p_storage_end = display.patterns + 10;
+
+    segment_mask curr_mask = 0;
+    for (size_t i = 0; i <= line.size(); ++i) {
+        char c = i < line.size() ? line[i] : ' ';
+
+        if (c >= 'a' && c <= 'g') {
+            curr_mask |= static_cast<segment_mask>(1 << (c - 'a'));
         }
-        else if (display.patterns[i].find(c) == string::npos) {
-            digit_patterns[5] = display.patterns[i];
+        else if (c == ' ') {
+            if (curr_mask == 0) continue;
+            if (p_storage == p_storage_end) throw runtime_error("Too many patterns in display");
+
+            *p_storage++ = curr_mask;
+            curr_mask = 0;
+        }
+        else if (c == '|') {
+            if (p_storage != p_storage_end) throw runtime_error("Expected 10 patterns before '|'");
+
+            p_storage = display.outputs;
+            p_storage_end = display.outputs + 4;
         }
         else {
-            digit_patterns[2] = display.patterns[i];
+            throw runtime_error("Invalid character in display");
         }
     }
+    if (p_storage != display.outputs + 4) throw runtime_error("Expected 4 output digits after '|'");
 
-    int decoded_output = 0;
-    int multiplier = 1000;
-    for (const string &digit_pattern : display.outputs) {
-        for (int i = 0; i < 10; ++i) {
-            if (digit_pattern == digit_patterns[i]) {
-                decoded_output += i * multiplier;
-                multiplier /= 10;
-                break;
+    return display;
+}
+
+int64_t decode_batch(const display_batch &batch) {
+    uint32_t signatures[batch_size];
+    batch_signatures(batch, signatures);
+
+    int64_t outputs_sum = 0;
+    for (size_t lane = 0; lane < batch.n_displays; ++lane) {
+        const wiring_entry &wiring = find_wiring(signatures[lane]);
+
+        int decoded_output = 0;
+        for (int i_output = 0; i_output < 4; ++i_output) {
+            segment_mask output = batch.outputs[i_output][lane];
+            segment_mask segments = 0;
+            for (int wire = 0; wire < 7; ++wire) {
+                if (output & (1 << wire)) segments |= static_cast<segment_mask>(1 << wiring.segment_for_wire[wire]);
             }
+
+            uint8_t digit = g_digit_for_segments[segments];
+            if (digit > 9) throw runtime_error("Output digit does not match any pattern");
+
+            decoded_output = decoded_output * 10 + digit;
         }
+
+        outputs_sum += decoded_output;
     }
 
-    return decoded_output;
+    return outputs_sum;
 }
 
-string diff(const string &lhs, const string &rhs) {
-    string result;
-    for (char lhs_char : lhs) {
-        if (rhs.find(lhs_char) == string::npos) {
-            result.append(1, lhs_char);
+void batch_signatures(const display_batch &batch, uint32_t signatures[batch_size]) {
+    uint32_t wire_counts[7][batch_size] = {};
+    segment_mask four[batch_size] = {};
+
+    for (int i_pattern = 0; i_pattern < 10; ++i_pattern) {
+        const segment_mask *patterns = batch.patterns[i_pattern];
+
+        for (int wire = 0; wire < 7; ++wire) {
+            for (size_t lane = 0; lane < batch_size; ++lane) {
+                wire_counts[wire][lane] += (patterns[lane] >> wire) & 1;
+            }
+        }
+        for (size_t lane = 0; lane < batch_size; ++lane) {
+            four[lane] |= popcount(patterns[lane]) == 4 ? patterns[lane] : 0;
         }
     }
 
-    return result;
+    for (size_t lane = 0; lane < batch_size; ++lane) {
+        signatures[lane] = 0;
+    }
+    for (int wire = 0; wire < 7; ++wire) {
+        for (size_t lane = 0; lane < batch_size; ++lane) {
+            uint32_t in_four = (four[lane] >> wire) & 1;
+            signatures[lane] |= ((wire_counts[wire][lane] - 4) | (in_four << 3)) << (4 * wire);
+        }
+    }
 }
 
-string diff(const string &lhs, char rhs) {
-    return diff(lhs, string(1, rhs));
+const wiring_entry &find_wiring(uint32_t signature) {
+    size_t slot = wiring_table_slot(signature);
+    while (g_wiring_table[slot].signature != signature) {
+        if (g_wiring_table[slot].signature == 0) throw runtime_error("Display does not match any wiring");
+
+        slot = (slot + 1) % wiring_table_size;
+    }
+
+    return g_wiring_table[slot];
 }
@@ -1,15 +1,30 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
-const int max_size = 100;
-int g_rows, g_cols;
-int g_map[max_size][max_size];
+class height_map {
+public:
+    // cells outside the map read as this height, so neighbour accesses need no bounds checks
+    static constexpr uint8_t border_height = 9;
 
-void parse_input(const string &filename);
-int calculate_risk_level();
+    height_map(istream &input);
+
+    int rows() const;
+    int cols() const;
+
+    // row(-1) and row(rows()) are border rows, and each row's [-1] and [cols()] are border cells
+    const uint8_t *row(int i) const;
+
+private:
+    vector<uint8_t> cells;
+    int _rows;
+    int _cols;
+};
+
+int64_t calculate_risk_level(const height_map &map);
 
 
 int main(int argc, char *argv[]) {
@@ -19,46 +34,71 @@ int main(int argc, char *argv[]) {
     }
     const string filename = argv[1];
 
-    parse_input(filename);
+    ifstream input_file(filename);
+    height_map map(input_file);
 
-    cout << "Risk level: " << calculate_risk_level() << endl;
+    cout << "Risk level: " << calculate_risk_level(map) << endl;
 }
 
-void parse_input(const string &filename) {
-    ifstream input_file(filename);
+height_map::height_map(istream &input) {
+    this->_rows = 0;
+    this->_cols = 0;
 
-    size_t i_row;
     string line;
-    for (i_row = 0; getline(input_file, line); ++i_row) {
-        g_cols = static_cast<int>(line.size());
-        for (size_t i_col = 0; i_col < line.size(); ++i_col) {
-            g_map[i_row][i_col] = line[i_col] - '0';
+    while (getline(input, line)) {
+        if (line.empty()) continue;
+
+        if (this->_rows == 0) {
+            this->_cols = static_cast<int>(line.size());
+            this->cells.assign(line.size() + 2, border_height);
+        }
+        else if (static_cast<int>(line.size()) != this->_cols) {
+            throw runtime_error("Height map rows differ in length");
         }
+
+        this->cells.push_back(border_height);
+        for (char c : line) {
+            if (c < '0' || c > '9') throw runtime_error("Invalid height");
+
+            this->cells.push_back(static_cast<uint8_t>(c - '0'));
+        }
+        this->cells.push_back(border_height);
+        ++this->_rows;
     }
 
-    g_rows = static_cast<int>(i_row);
+    this->cells.insert(this->cells.end(), static_cast<size_t>(this->_cols) + 2, border_height);
 }
 
-int calculate_risk_level() {
-    int risk_level = 0;
-
-    auto height = [] (int i, int j) {
-        if (i < 0 || j < 0 || i >= g_rows || j >= g_cols) return numeric_limits<int>::max();
+int height_map::rows() const {
+    return this->_rows;
+}
 
-        return g_map[i][j];
-    };
+int height_map::cols() const {
+    return this->_cols;
+}
 
-    for (int i = 0; i < g_rows; ++i) {
-        for (int j = 0; j < g_cols; ++j) {
-            int curr_height = g_map[i][j];
-            if (curr_height < height(i, j - 1) &&
-                curr_height < height(i, j + 1) &&
-                curr_height < height(i - 1, j) &&
-                curr_height < height(i + 1, j)) {
+const uint8_t *height_map::row(int i) const {
+    return this->cells.data() + static_cast<ptrdiff_t>(i + 1) * (this->_cols + 2) + 1;
+}
 
-                risk_level += curr_height + 1;
-            }
+int64_t calculate_risk_level(const height_map &map) {
+    int64_t risk_level = 0;
+
+    for (int i = 0; i < map.rows(); ++i) {
+        const uint8_t *up = map.row(i - 1);
+        const uint8_t *curr = map.row(i);
+        const uint8_t *down = map.row(i + 1);
+
+        // compare the row against its four shifted neighbour rows without branching, so that the
+        // loop vectorises
+        uint32_t row_risk_level = 0;
+        for (int j = 0; j < map.cols(); ++j) {
+            uint8_t h = curr[j];
+            uint32_t is_low_point = (h < curr[j - 1]) & (h < curr[j + 1]) & (h < up[j]) & (h < down[j]);
+            row_risk_level += is_low_point * (h + 1u);
         }
+
+        risk_level += row_risk_level;
     }
 
     return risk_level;
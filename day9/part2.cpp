@@ -2,22 +2,43 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <exception>
 
 using namespace std;
 
-struct coord {
-    int x;
-    int y;
+class height_map {
+public:
+    // cells outside the map read as this height, so neighbour accesses need no bounds checks
+    static constexpr uint8_t border_height = 9;
+
+    height_map(istream &input);
+
+    int rows() const;
+    int cols() const;
+
+    // row(-1) and row(rows()) are border rows, and each row's [-1] and [cols()] are border cells
+    const uint8_t *row(int i) const;
+
+private:
+    vector<uint8_t> cells;
+    int _rows;
+    int _cols;
 };
 
-const int max_size = 100;
-int g_rows, g_cols;
-int g_map[max_size][max_size];
+// Basin labels of one horizontal strip of the map, local to the strip. The labels of the strip's
+// first and last rows are kept so that basins can be joined across the seams between strips.
+struct strip_labels {
+    vector<int> first_row_roots;
+    vector<int> last_row_roots;
+    vector<int64_t> root_sizes;
+};
 
-void parse_input(const string &filename);
-vector<coord> find_low_points();
-vector<int> calculate_basin_sizes(const vector<coord> &low_points);
-int explore_basin(int x, int y);
+vector<int64_t> calculate_basin_sizes(const height_map &map, unsigned n_threads);
+strip_labels label_strip(const height_map &map, int begin_row, int end_row);
+int find_root(vector<int> &parents, int label);
 
 
 int main(int argc, char *argv[]) {
@@ -27,11 +48,12 @@ int main(int argc, char *argv[]) {
     }
     const string filename = argv[1];
 
-    parse_input(filename);
+    ifstream input_file(filename);
+    height_map map(input_file);
 
-    vector<coord> low_points = find_low_points();
-    vector<int> basin_sizes = calculate_basin_sizes(low_points);
-    sort(basin_sizes.begin(), basin_sizes.end(), greater<int>());
+    vector<int64_t> basin_sizes = calculate_basin_sizes(map, max(1u, thread::hardware_concurrency()));
+    if (basin_sizes.size() < 3) throw runtime_error("Less than 3 basins found");
+    nth_element(basin_sizes.begin(), basin_sizes.begin() + 2, basin_sizes.end(), greater<int64_t>());
 
     int64_t result = 1;
     for (size_t i = 0; i < 3; ++i) {
@@ -41,73 +63,187 @@ int main(int argc, char *argv[]) {
     cout << "Basin sizes score: " << result << endl;
 }
 
-void parse_input(const string &filename) {
-    ifstream input_file(filename);
+height_map::height_map(istream &input) {
+    this->_rows = 0;
+    this->_cols = 0;
 
-    size_t i_row;
     string line;
-    for (i_row = 0; getline(input_file, line); ++i_row) {
-        g_cols = static_cast<int>(line.size());
-        for (size_t i_col = 0; i_col < line.size(); ++i_col) {
-            g_map[i_row][i_col] = line[i_col] - '0';
+    while (getline(input, line)) {
+        if (line.empty()) continue;
+
+        if (this->_rows == 0) {
+            this->_cols = static_cast<int>(line.size());
+            this->cells.assign(line.size() + 2, border_height);
+        }
+        else if (static_cast<int>(line.size()) != this->_cols) {
+            throw runtime_error("Height map rows differ in length");
+        }
+
+        this->cells.push_back(border_height);
+        for (char c : line) {
+            if (c < '0' || c > '9') throw runtime_error("Invalid height");
+
+            this->cells.push_back(static_cast<uint8_t>(c - '0'));
         }
+        this->cells.push_back(border_height);
+        ++this->_rows;
     }
 
-    g_rows = static_cast<int>(i_row);
+    this->cells.insert(this->cells.end(), static_cast<size_t>(this->_cols) + 2, border_height);
 }
 
-int height(int x, int y) {
-    if (x < 0 || y < 0 || x >= g_rows || y >= g_cols) return numeric_limits<int>::max();
-
-    return g_map[x][y];
+int height_map::rows() const {
+    return this->_rows;
 }
 
-vector<coord> find_low_points() {
-    vector<coord> low_points;
+int height_map::cols() const {
+    return this->_cols;
+}
 
-    for (int i = 0; i < g_rows; ++i) {
-        for (int j = 0; j < g_cols; ++j) {
-            int curr_height = g_map[i][j];
-            if (curr_height < height(i, j - 1) &&
-                curr_height < height(i, j + 1) &&
-                curr_height < height(i - 1, j) &&
-                curr_height < height(i + 1, j)) {
+const uint8_t *height_map::row(int i) const {
+    return this->cells.data() + static_cast<ptrdiff_t>(i + 1) * (this->_cols + 2) + 1;
+}
 
-                low_points.push_back({i, j});
+vector<int64_t> calculate_basin_sizes(const height_map &map, unsigned n_threads) {
+    // the strips are labelled in parallel, then their local labels are given disjoint ranges of
+    // global labels and joined wherever the basins cross a seam
+    const int n_strips = max(1, min(static_cast<int>(n_threads), map.rows()));
+    vector<strip_labels> strips(static_cast<size_t>(n_strips));
+
+    vector<exception_ptr> strip_errors(static_cast<size_t>(n_strips));
+    vector<thread> threads;
+    for (int i_strip = 0; i_strip < n_strips; ++i_strip) {
+        int begin_row = static_cast<int>(static_cast<int64_t>(map.rows()) * i_strip / n_strips);
+        int end_row = static_cast<int>(static_cast<int64_t>(map.rows()) * (i_strip + 1) / n_strips);
+
+        threads.emplace_back([&, i_strip, begin_row, end_row] () {
+            try {
+                strips[static_cast<size_t>(i_strip)] = label_strip(map, begin_row, end_row);
             }
-        }
+            catch (...) {
+                strip_errors[static_cast<size_t>(i_strip)] = current_exception();
+            }
+        });
+    }
+    for (thread &thread : threads) {
+        thread.join();
+    }
+    for (const exception_ptr &strip_error : strip_errors) {
+        if (strip_error) rethrow_exception(strip_error);
     }
 
-    return low_points;
-}
+    vector<int> label_offsets;
+    vector<int64_t> label_sizes;
+    for (const strip_labels &strip : strips) {
+        label_offsets.push_back(static_cast<int>(label_sizes.size()));
+        label_sizes.insert(label_sizes.end(), strip.root_sizes.begin(), strip.root_sizes.end());
+    }
+
+    vector<int> parents(label_sizes.size());
+    for (size_t label = 0; label < parents.size(); ++label) {
+        parents[label] = static_cast<int>(label);
+    }
 
-vector<int> calculate_basin_sizes(const vector<coord> &low_points) {
-    vector<int> basin_sizes;
+    for (size_t i_seam = 0; i_seam + 1 < strips.size(); ++i_seam) {
+        const vector<int> &upper_roots = strips[i_seam].last_row_roots;
+        const vector<int> &lower_roots = strips[i_seam + 1].first_row_roots;
 
-    for (coord low_point : low_points) {
-        cout << "Exploring basin from low point [" << low_point.x << ", " << low_point.y << "]" << endl;
-        basin_sizes.push_back(explore_basin(low_point.x, low_point.y));
-        cout << endl;
+        for (size_t j = 0; j < upper_roots.size(); ++j) {
+            if (upper_roots[j] < 0 || lower_roots[j] < 0) continue;
+
+            int upper_root = find_root(parents, label_offsets[i_seam] + upper_roots[j]);
+            int lower_root = find_root(parents, label_offsets[i_seam + 1] + lower_roots[j]);
+            parents[static_cast<size_t>(max(upper_root, lower_root))] = min(upper_root, lower_root);
+        }
+    }
+
+    vector<int64_t> root_sizes(label_sizes.size());
+    for (size_t label = 0; label < label_sizes.size(); ++label) {
+        root_sizes[static_cast<size_t>(find_root(parents, static_cast<int>(label)))] += label_sizes[label];
+    }
+
+    vector<int64_t> basin_sizes;
+    for (int64_t size : root_sizes) {
+        if (size > 0) basin_sizes.push_back(size);
     }
 
     return basin_sizes;
 }
 
-int explore_basin(int x, int y) {
-    int basin_size = 1;
-    int curr_height = g_map[x][y];
-    g_map[x][y] = -curr_height;
+strip_labels label_strip(const height_map &map, int begin_row, int end_row) {
+    // Basins are the connected regions of cells below height 9. Every cell is labelled from its
+    // left and upper neighbours, labels which turn out to belong to the same basin are joined as
+    // union-find links, and cell counts are kept per label and summed into the roots at the end.
+    // Only the previous row's labels are needed, with -1 marking walls and the border.
+    const size_t row_size = static_cast<size_t>(map.cols()) + 2;
+    vector<int> prev_labels(row_size, -1);
+    vector<int> curr_labels(row_size, -1);
+    vector<int> first_row_labels;
+    vector<int> parents;
+    vector<int64_t> label_sizes;
+
+    for (int i = begin_row; i < end_row; ++i) {
+        const uint8_t *heights = map.row(i);
+
+        for (int j = 0; j < map.cols(); ++j) {
+            int &label = curr_labels[static_cast<size_t>(j) + 1];
+            if (heights[j] == 9) {
+                label = -1;
+                continue;
+            }
+
+            int left_label = curr_labels[static_cast<size_t>(j)];
+            int up_label = prev_labels[static_cast<size_t>(j) + 1];
 
-    cout << "[" << x << "," << y << "](" << curr_height << ") ";
+            if (left_label < 0 && up_label < 0) {
+                label = static_cast<int>(parents.size());
+                parents.push_back(label);
+                label_sizes.push_back(0);
+            }
+            else if (left_label < 0 || up_label < 0) {
+                label = max(left_label, up_label);
+            }
+            else {
+                int left_root = find_root(parents, left_label);
+                int up_root = find_root(parents, up_label);
+                parents[static_cast<size_t>(max(left_root, up_root))] = min(left_root, up_root);
+                label = left_label;
+            }
 
-    int height_left = height(x - 1, y);
-    if (curr_height < height_left && height_left < 9) basin_size += explore_basin(x - 1, y);
-    int height_right = height(x + 1, y);
-    if (curr_height < height_right && height_right < 9) basin_size += explore_basin(x + 1, y);
-    int height_up = height(x, y - 1);
-    if (curr_height < height_up && height_up < 9) basin_size += explore_basin(x, y - 1);
-    int height_down = height(x, y + 1);
-    if (curr_height < height_down && height_down < 9) basin_size += explore_basin(x, y + 1);
+            ++label_sizes[static_cast<size_t>(label)];
+        }
+
+        if (i == begin_row) first_row_labels = curr_labels;
+        swap(prev_labels, curr_labels);
+    }
+
+    strip_labels strip;
+    strip.root_sizes.assign(label_sizes.size(), 0);
+    for (size_t label = 0; label < label_sizes.size(); ++label) {
+        strip.root_sizes[static_cast<size_t>(find_root(parents, static_cast<int>(label)))] += label_sizes[label];
+    }
+
+    auto labels_to_roots = [&] (const vector<int> &labels) {
+        vector<int> roots;
+        for (size_t j = 1; j + 1 < labels.size(); ++j) {
+            roots.push_back(labels[j] < 0 ? -1 : find_root(parents, labels[j]));
+        }
+        return roots;
+    };
+    if (begin_row < end_row) {
+        strip.first_row_roots = labels_to_roots(first_row_labels);
+        strip.last_row_roots = labels_to_roots(prev_labels);
+    }
+
+    return strip;
+}
+
+int find_root(vector<int> &parents, int label) {
+    while (parents[static_cast<size_t>(label)] != label) {
+        int &parent = parents[static_cast<size_t>(label)];
+        parent = parents[static_cast<size_t>(parent)];  // path halving
+        label = parent;
+    }
 
-    return basin_size;
+    return label;
 }
@@ -0,0 +1,55 @@
+#include <istream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <exception>
+
+using namespace std;
+
+// Streams the non-empty lines of input in chunks of lines_per_thread * n_threads lines, every chunk
+// split into n_threads consecutive slices. process_slice(lines, i_begin, i_end, i_thread) runs on a
+// thread of its own per slice; once a chunk's threads are done, merge_slice(i_thread) runs on the
+// calling thread for every slice in order. Exceptions thrown by process_slice are rethrown there too.
+template<class process_fn, class merge_fn>
+void process_lines_in_parallel(istream &input, unsigned n_threads, const process_fn &process_slice, const merge_fn &merge_slice,
+                               size_t lines_per_thread = 16 * 1024) {
+    vector<string> lines(lines_per_thread * n_threads);
+
+    vector<exception_ptr> thread_errors(n_threads);
+    vector<thread> threads;
+
+    for (;;) {
+        size_t n_lines = 0;
+        while (n_lines < lines.size() && getline(input, lines[n_lines])) {
+            if (!lines[n_lines].empty()) ++n_lines;
+        }
+        if (n_lines == 0) break;
+
+        size_t lines_per_slice = (n_lines + n_threads - 1) / n_threads;
+        for (unsigned i_thread = 0; i_thread < n_threads; ++i_thread) {
+            size_t i_begin = min(n_lines, i_thread * lines_per_slice);
+            size_t i_end = min(n_lines, i_begin + lines_per_slice);
+
+            threads.emplace_back([&, i_thread, i_begin, i_end] () {
+                try {
+                    process_slice(lines, i_begin, i_end, i_thread);
+                }
+                catch (...) {
+                    thread_errors[i_thread] = current_exception();
+                }
+            });
+        }
+
+        for (thread &thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+
+        for (unsigned i_thread = 0; i_thread < n_threads; ++i_thread) {
+            if (thread_errors[i_thread]) rethrow_exception(thread_errors[i_thread]);
+
+            merge_slice(i_thread);
+        }
+    }
+}